@@ -1,63 +1,388 @@
 #ifndef RACC_BASE_H
 #define RACC_BASE_H
 
-#include <arena.h>
 #include <stddef.h>
+#include <stdint.h>
 
 /* ========== REGIONS ========== */
 
+/* regions are bump allocated in chunks, each twice the size of the last up to
+ * RACC_REGION_CHUNK_MAX, so a region which allocates little costs little */
+#define RACC_REGION_CHUNK_MIN 256
+#define RACC_REGION_CHUNK_MAX (1024 * 1024)
+/* size of each chunk of the scratch stack letregions allocate on */
+#define RACC_SCRATCH_CHUNK_SIZE (64 * 1024)
+/* most bytes of freed chunks and region headers kept for reuse */
+#ifndef RACC_REGION_POOL_MAX
+#define RACC_REGION_POOL_MAX (32 * 1024 * 1024)
+#endif
+/* build with -DRACC_REGION_DISCARD to let the kernel take back the pages of
+ * pooled chunks of RACC_REGION_CHUNK_MAX when memory runs short, using
+ * madvise(MADV_FREE), for a system call per chunk pooled */
+
+struct region_chunk {
+	struct region_chunk *next;
+	char *end;
+};
+
 struct region {
-	struct arena *arena;
+	struct region_chunk *chunks; /* newest first */
+	char *top;                   /* free space in the newest chunk */
+	char *end;
 	unsigned int reference_count;
+	int is_static; /* lives as long as the program, so is shared not copied */
+
+	/* letregions only, the scope outside it and the scratch stack's top on
+	 * entry, which it is reset to on exit, and the scratch chunk holding the
+	 * region itself, which renewing it resets the top to just past */
+	struct region *scope_outer;
+	struct region_chunk *scope_chunk;
+	char *scope_top;
+	struct region_chunk *scope_own_chunk;
+#ifdef RACC_PARALLEL
+	/* where its worker's sparks began on entry, and how many sparks of things
+	 * in it other workers are running, which exit waits for */
+	long spark_bottom;
+	unsigned int sparks_running;
+#endif
 };
 
 struct region *region_new(void);
 void region_free(struct region *);
 void region_retain(struct region *);
 void region_release(struct region *);
+/* zeroed, pointer aligned */
+void *region_push(struct region *, size_t);
+
+/* letregions nest as the calls running in them do. the innermost one bump
+ * allocates from a scratch stack they all share, and exiting it resets the
+ * stack to where it was on entry in O(1), whatever its reference count, as
+ * nothing allocated in it is used after. a letregion no longer innermost,
+ * when a thunk in it is forced from an inner one, allocates in chunks of its
+ * own, freed on exit */
+struct region *region_enter(void);
+void region_exit(struct region *);
+/* frees what is in the innermost letregion, which stays entered at the same
+ * address, so whoever entered it still exits it */
+void region_renew(struct region *);
+/* whether region is freed no sooner than other, so other can share what is in
+ * it rather than copying */
+int region_outlives(struct region *region, struct region *other);
 
 struct region r_global;
 
 #define region_push_struct(REGION, TYPE)                                       \
-	(arena_push_struct_zero(REGION->arena, TYPE))
+	((TYPE *)region_push(REGION, sizeof(TYPE)))
+
+/* size of data built by one constructor, which needn't be as large as the
+ * union of every constructor's fields. rounded up to keep pushes aligned */
+#define data_size(TYPE, CONSTRUCTOR)                                           \
+	size_aligned(offsetof(TYPE, v) + sizeof(((TYPE *)0)->v.CONSTRUCTOR))
+#define size_aligned(SIZE)                                                     \
+	(((SIZE) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+#ifdef RACC_GC_COPYING
+#define region_push_data(REGION, TYPE, CONSTRUCTOR)                            \
+	((void)(REGION), (TYPE *)gc_alloc(&layout_##CONSTRUCTOR))
+#else
+#define region_push_data(REGION, TYPE, CONSTRUCTOR)                            \
+	((TYPE *)region_push(REGION, data_size(TYPE, CONSTRUCTOR)))
+#endif
+
+/* ========== GARBAGE COLLECTION ========== */
+
+#ifdef RACC_GC_COPYING
+
+/* the runtime built with -DRACC_GC_COPYING, for programs compiled with
+ * racc --gc=copying, allocates everything in a heap reclaimed by a
+ * generational copying collector rather than in regions. the heap is a single
+ * reservation of address space, split into blocks */
+#define RACC_GC_BLOCK_SIZE (32 * 1024)
+/* bytes allocated between minor collections */
+#ifndef RACC_GC_NURSERY_SIZE
+#define RACC_GC_NURSERY_SIZE (4 * 1024 * 1024)
+#endif
+/* address space reserved for the heap, only touched as it is used */
+#ifndef RACC_GC_HEAP_MAX
+#define RACC_GC_HEAP_MAX ((size_t)16 * 1024 * 1024 * 1024)
+#endif
+
+struct gc_stats {
+	size_t minor;      /* collections of the nursery */
+	size_t major;      /* collections of the whole heap */
+	size_t blocks;     /* blocks currently in use */
+	size_t blocks_max; /* high water mark of blocks */
+};
+
+struct gc_stats gc_stats;
+
+void gc_stats_print(void);
+
+struct thunk;
+struct object_layout;
+
+/* called first thing in main. stack_top is in main's frame, above any frame
+ * holding heap pointers, and roots the program's top level value thunks,
+ * NULL terminated */
+void gc_init(void *stack_top, struct thunk **roots);
+/* zeroed, may collect first. the object's layout is kept in the word before
+ * it, for the collector to find its size and the pointers in it */
+void *gc_alloc(const struct object_layout *);
+/* moves what field points to, if it is in the part
+ * of the heap being collected, and updates field. tagged pointers and
+ * immediates are fine */
+void gc_evacuate(void **field);
+/* to be called after writing a pointer into an object which may be older than
+ * what it now points to, so minor collections see it */
+void gc_remember(void *object);
+
+#endif
+
+/* ========== EVALUATION STACK ========== */
+
+/* size of each heap allocated stack segment deep evaluations run on */
+#define RACC_STACK_SEGMENT_SIZE (4 * 1024 * 1024)
+/* stack left when evaluation moves onto a new segment */
+#define RACC_STACK_RED_ZONE (256 * 1024)
+
+struct eval_stats {
+	size_t depth;        /* thunks currently being evaluated */
+	size_t depth_max;    /* high water mark of depth */
+	size_t segments;     /* stack segments currently in use */
+	size_t segments_max; /* high water mark of segments */
+};
+
+struct eval_stats eval_stats;
+
+void eval_stats_print(void);
+
+/* whether the C stack is running low. workers calling each other directly
+ * check it first, and go through a thunk instead so evaluation moves onto a
+ * new segment */
+int eval_stack_low(void);
+
+/* ========== PARALLELISM ========== */
+
+/* the runtime built with -DRACC_PARALLEL, for programs compiled with racc
+ * --par or --auto-par, has par evaluate its first argument on other cores.
+ * each worker keeps the thunks it sparks in a deque of its own, and idle
+ * workers steal the oldest from the others. a thunk is claimed before it is
+ * evaluated, so is evaluated once, and forcing one another worker has claimed
+ * waits for it. there are RACC_WORKERS workers, from the environment, or one
+ * per core, started at the first spark */
+#ifdef RACC_PARALLEL
+#ifdef RACC_GC_COPYING
+#error "RACC_PARALLEL needs regions, not the copying collector"
+#endif
+/* sparks each worker holds, more are dropped as the rest is work enough */
+#define RACC_SPARKS_MAX 4096
+/* stack of each worker other than the main thread */
+#define RACC_WORKER_STACK_SIZE (64 * 1024 * 1024)
+#endif
+
+struct thunk;
+
+/* offers a thunk to idle workers */
+#ifdef RACC_PARALLEL
+void spark(struct thunk *);
+/* whether a thunk sparked now would likely be stolen, there being fewer sparks
+ * waiting than idle workers. code parallelised by the compiler asks before
+ * building a thunk for a strict argument, which it otherwise evaluates
+ * straight away, so sparks are only made where they are needed */
+int spark_wanted(void);
+#else
+#define spark(THUNK) ((void)(THUNK))
+#define spark_wanted() 0
+#endif
 
 /* ========== CLOSURES/THUNKS ========== */
 
 struct thunk;
 
+/* a saturated call, run when its thunk is forced. closures are never mutated
+ * after construction so thunk copies can share them */
 struct closure {
-	size_t fn_arity;
-	size_t args_len;
 	struct thunk **args;
 	void *(*fn)(struct thunk **, struct region *);
 };
 
+/* a partial application: the value of a function typed thunk */
+struct pap {
+	size_t arity;
+	size_t args_len;
+	void *(*fn)(struct thunk **, struct region *);
+	struct thunk **args;
+};
+
+enum thunk_state {
+	THUNK_UNEVALUATED,
+	THUNK_BLACKHOLE, /* being evaluated, forcing it again is a loop */
+	THUNK_EVALUATED,
+	THUNK_INDIRECTION /* evaluates to the same as the thunk in value */
+};
+
+struct thunk_info;
+
+struct field_layout {
+	size_t offset;
+	const struct thunk_info *info; /* a strict field's data type, else NULL */
+};
+
+/* how big an object is and where the pointers in it are. generated code has a
+ * table of them per data type, one for each constructor with fields, which a
+ * single routine walks to copy any data and the collector to scan it */
+struct object_layout {
+	size_t size;
+	size_t fields_len;
+	const struct field_layout *fields; /* fields holding pointers */
+};
+
+enum value_kind {
+	VALUE_IMMEDIATE, /* Int, Char, Bool and enums, held in place of a pointer */
+	VALUE_FN,        /* a pap */
+	VALUE_DATA       /* possibly tagged data, or a nullary constructor */
+};
+
+/* what thunks of a type share, so each thunk needn't hold it, describing the
+ * values of the type. pointer aligned, leaving the low bits of a pointer to it
+ * for the thunk's state */
+struct thunk_info {
+	enum value_kind kind;
+	/* data only, each constructor's layout by its enum value, NULL for those
+	 * without fields */
+	const struct object_layout *const *constructors;
+};
+
+#define THUNK_STATE_MASK ((uintptr_t)3)
+
+/* 24 bytes, the most numerous heap object */
 struct thunk {
 	struct region *region;
-	int evaluated;
-	void *(*value_copy)(void *, struct region *);
+	uintptr_t info; /* struct thunk_info*, plus the enum thunk_state */
 
-	/* evaluated = 1 */
-	void *value;
+	union {
+		/* state = THUNK_EVALUATED or THUNK_INDIRECTION */
+		void *value;
 
-	/* evaluated = 0 */
-	struct closure *closure;
+		/* state = THUNK_UNEVALUATED or THUNK_BLACKHOLE, released on update */
+		struct closure *closure;
+	} v;
 };
 
+/* addition rather than or, so it is still a constant initializer */
+#define thunk_info_state(INFO, STATE) ((uintptr_t)(INFO) + (STATE))
+#ifdef RACC_PARALLEL
+/* the value is written before the state says it is there */
+#define thunk_state(THUNK)                                                     \
+	((enum thunk_state)(__atomic_load_n(&(THUNK)->info, __ATOMIC_ACQUIRE) &      \
+	                    THUNK_STATE_MASK))
+#else
+#define thunk_state(THUNK)                                                     \
+	((enum thunk_state)((THUNK)->info & THUNK_STATE_MASK))
+#endif
+#define thunk_info(THUNK)                                                      \
+	((const struct thunk_info *)((THUNK)->info & ~THUNK_STATE_MASK))
+#define thunk_set_state(THUNK, STATE)                                          \
+	((THUNK)->info = ((THUNK)->info & ~THUNK_STATE_MASK) | (STATE))
+
 void *_thunk_eval(struct thunk *);
-#define thunk_eval(THUNK, TYPE) ((TYPE)_thunk_eval(THUNK))
-struct thunk *thunk_closure(struct closure *,
-                            struct region *,
-                            void *(*)(void *, struct region *));
+#define thunk_eval(THUNK, TYPE)                                                \
+	(thunk_state(THUNK) == THUNK_EVALUATED ? (TYPE)(THUNK)->v.value              \
+	                                       : (TYPE)_thunk_eval(THUNK))
+/* reads a thunk out of a data structure field, removing indirections */
+struct thunk *_thunk_follow(struct thunk **);
+#define thunk_follow(FIELD)                                                    \
+	(thunk_state(*(FIELD)) == THUNK_INDIRECTION ? _thunk_follow(FIELD)           \
+	                                            : *(FIELD))
 struct thunk *
-thunk_lit(void *, struct region *, void *(*)(void *, struct region *));
-struct thunk *thunk_apply(struct thunk *, struct thunk *);
+thunk_closure(struct closure *, struct region *, const struct thunk_info *);
+struct thunk *thunk_lit(void *, struct region *, const struct thunk_info *);
+/* the thunk itself if its region outlives region. otherwise a lazy copy in
+ * region, forwarding to the thunk until first forced, then holding a copy of
+ * its value one level deep, so substructure never reached is never copied */
 struct thunk *thunk_copy(struct thunk *, struct region *);
 void thunk_retain(struct thunk *);
 void thunk_release(struct thunk *);
 
+/* ========== EVAL/APPLY ========== */
+
+/* the most arguments a single apply_N entry point takes. longer unknown calls
+ * are split into a chain of applications */
+#define RACC_APPLY_MAX 8
+
+/* known function, exactly fn_arity arguments: a direct call */
+struct thunk *thunk_call(void *(*fn)(struct thunk **, struct region *),
+                         struct region *,
+                         const struct thunk_info *,
+                         size_t args_len,
+                         ...);
+/* known function, fewer than fn_arity arguments: an evaluated pap */
+struct thunk *thunk_pap(void *(*fn)(struct thunk **, struct region *),
+                        size_t fn_arity,
+                        struct region *,
+                        size_t args_len,
+                        ...);
+/* unknown function: dispatched on the pap arity when forced */
+struct thunk *thunk_apply(struct thunk *fn_thunk,
+                          struct region *,
+                          const struct thunk_info *,
+                          size_t args_len,
+                          ...);
+void *pap_apply(struct pap *, size_t, struct thunk **, struct region *);
+const struct thunk_info info_Fn;
+
+void *apply_1(struct thunk **, struct region *);
+void *apply_2(struct thunk **, struct region *);
+void *apply_3(struct thunk **, struct region *);
+void *apply_4(struct thunk **, struct region *);
+void *apply_5(struct thunk **, struct region *);
+void *apply_6(struct thunk **, struct region *);
+void *apply_7(struct thunk **, struct region *);
+void *apply_8(struct thunk **, struct region *);
+
+/* ========== TAIL CALLS ========== */
+
+/* returned by a function in place of its result to have the trampoline make
+ * the call, so mutually recursive tail calls run in constant stack */
+void *tail_call(void *(*fn)(struct thunk **, struct region *),
+                struct region *,
+                size_t args_len,
+                ...);
+/* returned by a function in place of its result when the result is an
+ * existing thunk. the thunk being updated becomes an indirection to it */
+void *tail_eval(struct thunk *);
+/* calls fn, then any tail calls it returns until one produces a value */
+void *trampoline(void *(*fn)(struct thunk **, struct region *),
+                 struct thunk **args,
+                 struct region *);
+
 /* ========== LANGUAGE DEFINED DATA TYPES ========== */
 
+/* nullary constructors aren't allocated. in place of a pointer to data they
+ * are an immediate value, their type tagged with the low bit, so matching one
+ * compares a register rather than loading memory. data types with only
+ * nullary constructors are plain enums */
+#define data_nullary(TYPE) ((void *)(((uintptr_t)(TYPE) << 1) | 1))
+#define data_is_nullary(DATA) (((uintptr_t)(DATA)&1) != 0)
+
+/* data is pointer aligned, as every region push is a multiple of the pointer
+ * size, leaving the low bits of a pointer to it clear. data types with up to
+ * DATA_TAGS_MAX constructors with fields keep the constructor's index in them,
+ * so matching an evaluated value needs no memory access. a nullary value has
+ * the low bit set, so never has a constructor's tag */
+#define DATA_TAGS_MAX 3
+#define DATA_TAG_MASK ((uintptr_t)7)
+#define data_tag(INDEX) ((uintptr_t)((INDEX) + 1) << 1)
+#define data_has_tag(DATA, INDEX)                                              \
+	(((uintptr_t)(DATA)&DATA_TAG_MASK) == data_tag(INDEX))
+/* pointer arithmetic rather than masking, so tagged static data is still a
+ * constant initializer, and untagging folds into field offsets */
+#define data_tagged(DATA, INDEX) ((void *)((char *)(DATA) + data_tag(INDEX)))
+#define data_untagged(DATA, INDEX) ((void *)((char *)(DATA)-data_tag(INDEX)))
+#define data_untagged_any(DATA)                                                \
+	((void *)((uintptr_t)(DATA) & ~DATA_TAG_MASK))
+/* the constructor's enum value, which untagged data starts with */
+#define data_constructor(DATA) (*(const unsigned int *)(DATA))
+
 /* lists */
 /* TODO rename to avoid potential collisions with user defined structures */
 
@@ -74,10 +399,17 @@ struct data_List {
 	} v;
 };
 
-void *value_copy_List(void *, struct region *);
+const struct thunk_info info_List;
+extern const struct object_layout layout_Cons;
 
+/* fills in a cons wherever it is, as fn_X_init does for user defined data */
+struct data_List *
+fn_Cons_init(struct data_List *, struct thunk *head, struct thunk *tail);
+void *fn_Cons(struct thunk **, struct region *);
+
+struct thunk _val_Null; /* for static data */
 struct thunk *val_Null;
-struct closure *closure_Cons;
+struct thunk *val_Cons;
 
 /* tuples */
 
@@ -98,9 +430,9 @@ struct base_Tuple *data_Tuple_Tuple(void);
 
 /* ========== LANGUAGE DEFINED FUNCTIONS ========== */
 
-void *value_copy_Int(void *value, struct region *region);
-void *value_copy_Char(void *value, struct region *region);
-void *value_copy_Bool(void *value, struct region *region);
+const struct thunk_info info_Int;
+const struct thunk_info info_Char;
+const struct thunk_info info_Bool;
 
 /* arithmetic */
 void *fn_add(struct thunk **, struct region *);
@@ -108,10 +440,10 @@ void *fn_sub(struct thunk **, struct region *);
 void *fn_mul(struct thunk **, struct region *);
 void *fn_div(struct thunk **, struct region *);
 
-struct closure *closure_add;
-struct closure *closure_sub;
-struct closure *closure_mul;
-struct closure *closure_div;
+struct thunk *val_add;
+struct thunk *val_sub;
+struct thunk *val_mul;
+struct thunk *val_div;
 
 /* comparisons */
 void *fn_eq(struct thunk **, struct region *);
@@ -120,10 +452,18 @@ void *fn_gt(struct thunk **, struct region *);
 void *fn_lte(struct thunk **, struct region *);
 void *fn_gte(struct thunk **, struct region *);
 
-struct closure *closure_eq;
-struct closure *closure_lt;
-struct closure *closure_gt;
-struct closure *closure_lte;
-struct closure *closure_gte;
+struct thunk *val_eq;
+struct thunk *val_lt;
+struct thunk *val_gt;
+struct thunk *val_lte;
+struct thunk *val_gte;
+
+/* par a b is b, evaluating a meanwhile if a worker is free. seq a b is b,
+ * once a is evaluated */
+void *fn_par(struct thunk **, struct region *);
+void *fn_seq(struct thunk **, struct region *);
+
+struct thunk *val_par;
+struct thunk *val_seq;
 
 #endif
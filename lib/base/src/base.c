@@ -1,190 +1,1741 @@
+#define _XOPEN_SOURCE 700 /* ucontext, getrlimit */
+#define _DEFAULT_SOURCE   /* madvise */
+
 #include "base.h"
-#include "arena.h"
 #include <assert.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <ucontext.h>
+#include <unistd.h>
+#ifdef RACC_PARALLEL
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#endif
+
+#ifndef RACC_GC_COPYING
+#define gc_remember(OBJECT) ((void)0) /* regions are never written back to */
+#endif
+
+/* state each worker keeps its own of */
+#ifdef RACC_PARALLEL
+#define per_thread __thread
+#else
+#define per_thread
+#endif
 
 /* ========== REGIONS ========== */
 
+#define chunk_data(CHUNK) ((char *)((CHUNK) + 1))
+#define chunk_capacity(CHUNK) ((size_t)((CHUNK)->end - chunk_data(CHUNK)))
+#define region_is_scope(REGION) ((REGION)->scope_chunk != NULL)
+
+/* chunks are sized in classes, each twice the last from RACC_REGION_CHUNK_MIN
+ * to RACC_REGION_CHUNK_MAX. freed ones are kept in a free list per class, and
+ * freed region headers in another, up to RACC_REGION_POOL_MAX bytes in all, so
+ * regions made and dropped over and over stop calling malloc. larger chunks go
+ * straight back */
+/* RACC_REGION_CHUNK_MIN << 12 is RACC_REGION_CHUNK_MAX */
+#define CHUNK_CLASSES 13
+
+static per_thread struct region_chunk *chunks_free[CHUNK_CLASSES];
+static per_thread struct region *regions_free; /* linked through scope_outer */
+static per_thread size_t pool_size;
+
+static size_t chunk_class(size_t size) {
+	size_t size_class = 0;
+	while (((size_t)RACC_REGION_CHUNK_MIN << size_class) < size) {
+		size_class++;
+	}
+	return size_class;
+}
+
+/* lets the kernel take back the pages of a pooled chunk when memory runs
+ * short, without unmapping them. reclaimed pages read as zero, and every push
+ * is zeroed anyway */
+static void chunk_discard(struct region_chunk *chunk) {
+#if defined(RACC_REGION_DISCARD) && defined(MADV_FREE)
+	uintptr_t page  = (uintptr_t)sysconf(_SC_PAGESIZE);
+	uintptr_t start = ((uintptr_t)chunk_data(chunk) + page - 1) & ~(page - 1);
+	uintptr_t end   = (uintptr_t)chunk->end & ~(page - 1);
+	if (chunk_capacity(chunk) >= RACC_REGION_CHUNK_MAX && end > start) {
+		madvise((void *)start, end - start, MADV_FREE);
+	}
+#else
+	(void)chunk;
+#endif
+}
+
+static struct region_chunk *chunk_alloc(size_t size) {
+	size_t size_class = chunk_class(size);
+	struct region_chunk *chunk;
+	if (size_class < CHUNK_CLASSES && chunks_free[size_class] != NULL) {
+		chunk                   = chunks_free[size_class];
+		chunks_free[size_class] = chunk->next;
+		pool_size -= chunk_capacity(chunk);
+	} else {
+		if (size_class < CHUNK_CLASSES) {
+			size = (size_t)RACC_REGION_CHUNK_MIN << size_class;
+		}
+		chunk      = malloc(sizeof(struct region_chunk) + size);
+		chunk->end = chunk_data(chunk) + size;
+	}
+	chunk->next = NULL;
+	return chunk;
+}
+
+static void chunk_free(struct region_chunk *chunk) {
+	size_t size_class = chunk_class(chunk_capacity(chunk));
+	if (size_class >= CHUNK_CLASSES ||
+	    pool_size + chunk_capacity(chunk) > RACC_REGION_POOL_MAX) {
+		free(chunk);
+		return;
+	}
+	chunk_discard(chunk);
+	chunk->next             = chunks_free[size_class];
+	chunks_free[size_class] = chunk;
+	pool_size += chunk_capacity(chunk);
+}
+
 struct region *region_new(void) {
-	struct region *region   = calloc(1, sizeof(struct region));
-	region->arena           = arena_alloc();
-	region->reference_count = 0;
+	struct region *region = regions_free;
+	if (region == NULL) {
+		return calloc(1, sizeof(struct region));
+	}
+	regions_free = region->scope_outer;
+	pool_size -= sizeof(struct region);
+	memset(region, 0, sizeof(struct region));
 	return region;
 }
 
 void region_free(struct region *region) {
-	arena_free(region->arena);
-	region->arena = NULL;
+	while (region->chunks != NULL) {
+		struct region_chunk *next = region->chunks->next;
+		chunk_free(region->chunks);
+		region->chunks = next;
+	}
+	region->top = NULL;
+	region->end = NULL;
+}
+
+#ifdef RACC_PARALLEL
+/* letregions are freed on exit whatever their count, and until then other
+ * workers can be pushing to them, so are left alone */
+void region_retain(struct region *region) {
+	if (!region->is_static && !region_is_scope(region)) {
+		__atomic_add_fetch(&region->reference_count, 1, __ATOMIC_RELAXED);
+	}
 }
 
+void region_release(struct region *region) {
+	if (region->is_static || region_is_scope(region) ||
+	    __atomic_sub_fetch(&region->reference_count, 1, __ATOMIC_ACQ_REL) != 0) {
+		return;
+	}
+#else
 void region_retain(struct region *region) { region->reference_count++; }
 
 void region_release(struct region *region) {
 	region->reference_count--;
-	if (region->reference_count == 0) {
-		region_free(region);
+	if (region->reference_count != 0 || region->is_static) {
+		return;
+	}
+#endif
+	region_free(region);
+	/* letregions are on the scratch stack, so aren't region_new's to reuse */
+	if (!region_is_scope(region) &&
+	    pool_size + sizeof(struct region) <= RACC_REGION_POOL_MAX) {
+		region->scope_outer = regions_free;
+		regions_free        = region;
+		pool_size += sizeof(struct region);
 	}
 }
 
-/* ========== CLOSURES/THUNKS ========== */
+static void region_grow(struct region *region, size_t size) {
+	struct region_chunk *chunk;
+	size_t chunk_size = RACC_REGION_CHUNK_MIN;
+	if (region->chunks != NULL) {
+		chunk_size = 2 * chunk_capacity(region->chunks);
+	}
+	if (chunk_size > RACC_REGION_CHUNK_MAX) {
+		chunk_size = RACC_REGION_CHUNK_MAX;
+	}
+	if (chunk_size < size) {
+		chunk_size = size;
+	}
+	chunk          = chunk_alloc(chunk_size);
+	chunk->next    = region->chunks;
+	region->chunks = chunk;
+#ifdef RACC_PARALLEL
+	/* the end is cleared first, so no push sees the new top with the old end */
+	__atomic_store_n(&region->end, NULL, __ATOMIC_RELAXED);
+	__atomic_store_n(&region->top, chunk_data(chunk), __ATOMIC_RELEASE);
+	__atomic_store_n(&region->end, chunk->end, __ATOMIC_RELEASE);
+#else
+	region->top = chunk_data(chunk);
+	region->end = chunk->end;
+#endif
+}
 
-void *_thunk_eval(struct thunk *thunk) {
-	if (!thunk->evaluated) {
-		thunk->value     = thunk->closure->fn(thunk->closure->args, thunk->region);
-		thunk->evaluated = 1;
+#ifdef RACC_PARALLEL
+/* regions other than a worker's innermost letregion can be pushed to by any
+ * worker, so the top is moved with a compare and swap, and growing takes one
+ * of a few locks, picked by the region's address */
+#define REGION_LOCKS 64
+
+static int region_locks[REGION_LOCKS];
+
+static void *region_push_shared(struct region *region, size_t size) {
+	int *lock = &region_locks[((uintptr_t)region >> 4) % REGION_LOCKS];
+	for (;;) {
+		char *top = __atomic_load_n(&region->top, __ATOMIC_ACQUIRE);
+		char *end = __atomic_load_n(&region->end, __ATOMIC_ACQUIRE);
+		if (end != NULL && end >= top && (size_t)(end - top) >= size) {
+			if (__atomic_compare_exchange_n(&region->top,
+			                                &top,
+			                                top + size,
+			                                0,
+			                                __ATOMIC_ACQ_REL,
+			                                __ATOMIC_RELAXED)) {
+				return top;
+			}
+			continue;
+		}
+		while (__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE)) {
+			sched_yield();
+		}
+		/* unless another worker grew it meanwhile */
+		if (__atomic_load_n(&region->top, __ATOMIC_RELAXED) == top) {
+			region_grow(region, size);
+		}
+		__atomic_store_n(lock, 0, __ATOMIC_RELEASE);
 	}
-	return thunk->value;
 }
+#endif
 
-static struct thunk *thunk_alloc(struct region *region) {
+/* the scratch stack. chunks past the top are kept for reuse, so letregions
+ * entered and exited over and over allocate no memory after the first */
+
+static per_thread struct region_chunk *scratch_chunk; /* holds the top */
+static per_thread char *scratch_top;
+static per_thread char *scratch_end;
+static per_thread struct region *scope_curr; /* innermost letregion */
+
+static void scratch_next(size_t size) {
+	struct region_chunk *next = scratch_chunk->next;
+	if (next == NULL || (size_t)(next->end - chunk_data(next)) < size) {
+		next                = chunk_alloc(
+			size > RACC_SCRATCH_CHUNK_SIZE ? size : RACC_SCRATCH_CHUNK_SIZE);
+		next->next          = scratch_chunk->next;
+		scratch_chunk->next = next;
+	}
+	scratch_chunk = next;
+	scratch_top   = chunk_data(next);
+	scratch_end   = next->end;
+}
+
+static void *scratch_push(size_t size) {
+	char *ptr;
+	if ((size_t)(scratch_end - scratch_top) < size) {
+		scratch_next(size);
+	}
+	ptr = scratch_top;
+	scratch_top += size;
+	return memset(ptr, 0, size);
+}
+
+void *region_push(struct region *region, size_t size) {
+	char *ptr;
+	size = size_aligned(size);
+	if (region == scope_curr) {
+		return scratch_push(size);
+	}
+#ifdef RACC_PARALLEL
+	ptr = region_push_shared(region, size);
+#else
+	if ((size_t)(region->end - region->top) < size) {
+		region_grow(region, size);
+	}
+	ptr = region->top;
+	region->top += size;
+#endif
+	return memset(ptr, 0, size);
+}
+
+#ifdef RACC_PARALLEL
+/* see parallelism */
+static long sparks_bottom(void);
+static void sparks_drop(long bottom);
+static void sparks_print(void);
+#endif
+
+struct region *region_enter(void) {
+	struct region_chunk *chunk;
+	char *top;
+	struct region *region;
+	if (scratch_chunk == NULL) {
+		scratch_chunk = chunk_alloc(RACC_SCRATCH_CHUNK_SIZE);
+		scratch_top   = chunk_data(scratch_chunk);
+		scratch_end   = scratch_chunk->end;
+	}
+	chunk               = scratch_chunk;
+	top                 = scratch_top;
+	region                  = scratch_push(sizeof(struct region));
+	region->scope_outer     = scope_curr;
+	region->scope_chunk     = chunk;
+	region->scope_top       = top;
+	region->scope_own_chunk = scratch_chunk;
+	scope_curr              = region;
+#ifdef RACC_PARALLEL
+	region->spark_bottom = sparks_bottom();
+#endif
+	return region;
+}
+
+/* sparks of what is in a letregion mustn't be run once it is freed */
+static void region_sparks_stop(struct region *region) {
+#ifdef RACC_PARALLEL
+	sparks_drop(region->spark_bottom);
+	while (__atomic_load_n(&region->sparks_running, __ATOMIC_ACQUIRE) != 0) {
+		sched_yield();
+	}
+#else
+	(void)region;
+#endif
+}
+
+void region_exit(struct region *region) {
+	assert(region == scope_curr);
+	region_sparks_stop(region);
+	region_free(region);
+	scope_curr    = region->scope_outer;
+	scratch_chunk = region->scope_chunk;
+	scratch_top   = region->scope_top;
+	scratch_end   = scratch_chunk->end;
+}
+
+void region_renew(struct region *region) {
+	assert(region == scope_curr);
+	region_sparks_stop(region);
+	region_free(region);
+	scratch_chunk = region->scope_own_chunk;
+	scratch_top   = (char *)(region + 1);
+	scratch_end   = scratch_chunk->end;
+}
+
+int region_outlives(struct region *region, struct region *other) {
+	struct region *scope;
+	if (region == NULL || region == other || region->is_static) {
+		return 1; /* a NULL region is malloc'd, so never freed */
+	}
+	if (other == NULL || !region_is_scope(other)) {
+		return 0;
+	}
+	for (scope = other->scope_outer; scope != NULL; scope = scope->scope_outer) {
+		if (scope == region) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* ========== EVALUATION STACK ========== */
+
+/* forcing a thunk runs its function, which forces the thunks it depends on,
+ * so a long chain of thunks recurses once per thunk. once the C stack runs low
+ * evaluation carries on in a heap allocated segment, then switches back when
+ * the thunk has its value. assumes the stack grows down */
+
+struct stack_segment {
+	struct stack_segment *prev;
+	char *base;
+	ucontext_t context;
+	ucontext_t caller;
+	struct thunk *thunk; /* being evaluated on this segment */
+	void *result;
+	char *caller_sp; /* where the caller's stack ends, for the collector */
+};
+
+struct eval_stats eval_stats;
+
+#ifdef RACC_PARALLEL
+static per_thread struct eval_stats *eval_stats_curr = &eval_stats;
+#else
+#define eval_stats_curr (&eval_stats)
+#endif
+
+/* switch segments when the stack passes this */
+static per_thread uintptr_t stack_limit;
+static per_thread struct stack_segment *segment_curr;
+static per_thread struct stack_segment *segments_free;
+
+/* uses no more of the stack than a segment, nor than its limit allows. the
+ * limit also counts what was used before stack_top, so a red zone of it is
+ * kept back. with a limit smaller than that, all evaluation runs on segments */
+static void stack_limit_init(char *stack_top) {
+	struct rlimit rlimit;
+	size_t stack_size = RACC_STACK_SEGMENT_SIZE;
+	if (getrlimit(RLIMIT_STACK, &rlimit) == 0 &&
+	    rlimit.rlim_cur != RLIM_INFINITY &&
+	    rlimit.rlim_cur < stack_size + RACC_STACK_RED_ZONE) {
+		stack_size = rlimit.rlim_cur > RACC_STACK_RED_ZONE
+		               ? rlimit.rlim_cur - RACC_STACK_RED_ZONE
+		               : 0;
+	}
+	stack_limit = (uintptr_t)stack_top - stack_size + RACC_STACK_RED_ZONE;
+}
+
+static void thunk_loop(void) {
+	fprintf(stderr, "<<loop>>\n");
+	exit(1);
+}
+
+static struct thunk *thunk_skip_indirections(struct thunk *thunk) {
+	while (thunk_state(thunk) == THUNK_INDIRECTION) {
+		thunk = thunk->v.value;
+	}
+	return thunk;
+}
+
+/* marks the thunk as being evaluated, unless it is already. in parallel only
+ * one worker can */
+static int thunk_claim(struct thunk *thunk) {
+#ifdef RACC_PARALLEL
+	uintptr_t info = __atomic_load_n(&thunk->info, __ATOMIC_RELAXED);
+	info &= ~THUNK_STATE_MASK;
+	return __atomic_compare_exchange_n(&thunk->info,
+	                                   &info,
+	                                   info | THUNK_BLACKHOLE,
+	                                   0,
+	                                   __ATOMIC_ACQUIRE,
+	                                   __ATOMIC_RELAXED);
+#else
+	if (thunk_state(thunk) != THUNK_UNEVALUATED) {
+		return 0;
+	}
+	thunk_set_state(thunk, THUNK_BLACKHOLE);
+	return 1;
+#endif
+}
+
+/* sets the state of a claimed thunk, once its value is written */
+static void thunk_publish(struct thunk *thunk, enum thunk_state state) {
+#ifdef RACC_PARALLEL
+	__atomic_store_n(&thunk->info,
+	                 (thunk->info & ~THUNK_STATE_MASK) | state,
+	                 __ATOMIC_RELEASE);
+#else
+	thunk_set_state(thunk, state);
+#endif
+}
+
+/* see parallelism */
+static void *thunk_wait(struct thunk *);
+
+/* see tail calls */
+static per_thread struct thunk *tail_eval_pending;
+static void *trampoline_run(void *(*)(struct thunk **, struct region *),
+                            struct thunk **,
+                            struct region *);
+
+/* runs the closure of a claimed thunk and updates thunk with its result,
+ * releasing the closure. when the result is another thunk, thunk becomes an
+ * indirection to it and evaluation carries on with that thunk in the same
+ * frame */
+static void *thunk_eval_here(struct thunk *thunk) {
+	void *result;
+
+	for (;;) {
+		struct thunk *target;
+
+		result = trampoline_run(
+			thunk->v.closure->fn, thunk->v.closure->args, thunk->region);
+		if (result != &tail_eval_pending) {
+			break;
+		}
+
+		target = thunk_skip_indirections(tail_eval_pending);
+		if (thunk_state(target) == THUNK_EVALUATED) {
+			result = target->v.value;
+			break;
+		}
+		/* the value takes the closure's place */
+		thunk->v.value = target;
+		thunk_publish(thunk, THUNK_INDIRECTION);
+		gc_remember(thunk);
+		if (!thunk_claim(target)) {
+			return thunk_wait(target);
+		}
+		thunk = target;
+	}
+
+	thunk->v.value = result;
+	thunk_publish(thunk, THUNK_EVALUATED);
+	gc_remember(thunk);
+	return result;
+}
+
+static void segment_entry(void) {
+	segment_curr->result = thunk_eval_here(segment_curr->thunk);
+}
+
+static void *thunk_eval_on_segment(struct thunk *thunk) {
+	struct stack_segment *segment = segments_free;
+	uintptr_t stack_limit_prev    = stack_limit;
+	char stack_marker;
+
+	if (segment == NULL) {
+		segment       = calloc(1, sizeof(struct stack_segment));
+		segment->base = malloc(RACC_STACK_SEGMENT_SIZE);
+		if (segment->base == NULL) {
+			fprintf(stderr, "Out of memory for evaluation stack\n");
+			exit(1);
+		}
+	} else {
+		segments_free = segment->prev;
+	}
+	segment->prev      = segment_curr;
+	segment->thunk     = thunk;
+	segment->caller_sp = &stack_marker;
+	segment_curr       = segment;
+	stack_limit    = (uintptr_t)segment->base + RACC_STACK_RED_ZONE;
+
+	eval_stats_curr->segments++;
+	if (eval_stats_curr->segments > eval_stats_curr->segments_max) {
+		eval_stats_curr->segments_max = eval_stats_curr->segments;
+	}
+
+	getcontext(&segment->context);
+	segment->context.uc_stack.ss_sp   = segment->base;
+	segment->context.uc_stack.ss_size = RACC_STACK_SEGMENT_SIZE;
+	segment->context.uc_link          = &segment->caller;
+	makecontext(&segment->context, segment_entry, 0);
+	swapcontext(&segment->caller, &segment->context);
+
+	/* keep the segment around for the next deep evaluation */
+	eval_stats_curr->segments--;
+	stack_limit   = stack_limit_prev;
+	segment_curr  = segment->prev;
+	segment->prev = segments_free;
+	segments_free = segment;
+	return segment->result;
+}
+
+/* evaluates a thunk this worker has claimed */
+static void *thunk_eval_claimed(struct thunk *thunk) {
+	char stack_marker;
+	void *result;
+
+	if (stack_limit == 0) {
+		stack_limit_init(&stack_marker);
+	}
+
+	eval_stats_curr->depth++;
+	if (eval_stats_curr->depth > eval_stats_curr->depth_max) {
+		eval_stats_curr->depth_max = eval_stats_curr->depth;
+	}
+
+	if ((uintptr_t)&stack_marker < stack_limit) {
+		result = thunk_eval_on_segment(thunk);
+	} else {
+		result = thunk_eval_here(thunk);
+	}
+
+	eval_stats_curr->depth--;
+	return result;
+}
+
+int eval_stack_low(void) {
+	char stack_marker;
+	if (stack_limit == 0) {
+		stack_limit_init(&stack_marker);
+	}
+	return (uintptr_t)&stack_marker < stack_limit;
+}
+
+void eval_stats_print(void) {
+	fprintf(stderr, "eval depth max:    %lu\n", eval_stats.depth_max);
+	fprintf(stderr, "stack segments max: %lu\n", eval_stats.segments_max);
+#ifdef RACC_PARALLEL
+	sparks_print();
+#endif
+}
+
+/* ========== PARALLELISM ========== */
+
+#ifdef RACC_PARALLEL
+
+struct spark {
 	struct thunk *thunk;
-	if (region == NULL) {
-		thunk = calloc(1, sizeof(struct thunk));
+	struct region *scope; /* the letregion the thunk is in, if any */
+};
+
+/* a Chase-Lev deque. its worker pushes and pops sparks at the bottom while
+ * the others steal from the top, the indices only growing as they wrap round
+ * sparks */
+struct spark_deque {
+	long top;
+	long bottom;
+	unsigned int stealing; /* other workers part way through a steal */
+	struct spark sparks[RACC_SPARKS_MAX];
+};
+
+struct worker {
+	pthread_t thread;
+	size_t index; /* in workers */
+	struct spark_deque deque;
+	struct thunk *waiting_on; /* claimed by another worker, or itself */
+	struct eval_stats eval_stats;
+	size_t sparks_created;
+	size_t sparks_stolen;
+	size_t sparks_fizzled; /* dropped, or evaluated before they were run */
+};
+
+static struct worker worker_main;
+static struct worker **workers;
+static size_t workers_len; /* 0 until the first spark */
+static per_thread struct worker *worker_curr = &worker_main;
+/* workers evaluating something, rather than idle or waiting on a thunk */
+static unsigned int workers_running = 1;
+
+/* whether every worker is idle or waits on a thunk still being evaluated,
+ * when none of those thunks ever will be. running is read again after, as a
+ * worker seen idle could have just finished waiting */
+static int workers_stuck(void) {
+	size_t i;
+	if (__atomic_load_n(&workers_running, __ATOMIC_SEQ_CST) != 0) {
+		return 0;
+	}
+	for (i = 0; i < workers_len; i++) {
+		struct thunk *thunk =
+			__atomic_load_n(&workers[i]->waiting_on, __ATOMIC_SEQ_CST);
+		if (thunk != NULL && thunk_state(thunk) != THUNK_BLACKHOLE) {
+			return 0;
+		}
+	}
+	return __atomic_load_n(&workers_running, __ATOMIC_SEQ_CST) == 0;
+}
+
+/* forces a thunk some worker has claimed. if it is this one, it is forcing
+ * itself and would never finish, which shows once every worker is stuck */
+static void *thunk_wait(struct thunk *thunk) {
+	struct worker *worker = worker_curr;
+	__atomic_store_n(&worker->waiting_on, thunk, __ATOMIC_SEQ_CST);
+	__atomic_sub_fetch(&workers_running, 1, __ATOMIC_SEQ_CST);
+	while (thunk_state(thunk) == THUNK_BLACKHOLE) {
+		if (workers_stuck()) {
+			thunk_loop();
+		}
+		sched_yield();
+	}
+	__atomic_add_fetch(&workers_running, 1, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&worker->waiting_on, NULL, __ATOMIC_SEQ_CST);
+	return _thunk_eval(thunk);
+}
+
+/* 0 when full, as there are sparks enough to keep the other workers busy */
+static int deque_push(struct spark_deque *deque, struct spark *spark) {
+	long bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+	long top    = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+	struct spark *slot;
+	if (bottom - top >= RACC_SPARKS_MAX) {
+		return 0;
+	}
+	slot = &deque->sparks[bottom % RACC_SPARKS_MAX];
+	__atomic_store_n(&slot->thunk, spark->thunk, __ATOMIC_RELAXED);
+	__atomic_store_n(&slot->scope, spark->scope, __ATOMIC_RELAXED);
+	__atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELEASE);
+	return 1;
+}
+
+static void deque_read(struct spark_deque *deque, long i, struct spark *spark) {
+	struct spark *slot = &deque->sparks[i % RACC_SPARKS_MAX];
+	spark->thunk       = __atomic_load_n(&slot->thunk, __ATOMIC_RELAXED);
+	spark->scope       = __atomic_load_n(&slot->scope, __ATOMIC_RELAXED);
+}
+
+/* the newest spark, racing thieves for the last one */
+static int deque_pop(struct spark_deque *deque, struct spark *spark) {
+	long bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+	long top;
+	int is_popped = 1;
+	__atomic_store_n(&deque->bottom, bottom, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	top = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+	if (top > bottom) {
+		__atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+		return 0;
+	}
+	deque_read(deque, bottom, spark);
+	if (top == bottom) {
+		is_popped = __atomic_compare_exchange_n(&deque->top,
+		                                        &top,
+		                                        top + 1,
+		                                        0,
+		                                        __ATOMIC_SEQ_CST,
+		                                        __ATOMIC_RELAXED);
+		__atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+	}
+	return is_popped;
+}
+
+/* the oldest spark */
+static int deque_steal(struct spark_deque *deque, struct spark *spark) {
+	long top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+	long bottom;
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+	if (top >= bottom) {
+		return 0;
+	}
+	deque_read(deque, top, spark);
+	return __atomic_compare_exchange_n(&deque->top,
+	                                   &top,
+	                                   top + 1,
+	                                   0,
+	                                   __ATOMIC_SEQ_CST,
+	                                   __ATOMIC_RELAXED);
+}
+
+static long sparks_bottom(void) {
+	return __atomic_load_n(&worker_curr->deque.bottom, __ATOMIC_RELAXED);
+}
+
+/* drops the sparks this worker made since its deque's bottom was at bottom,
+ * then waits for any steal under way, so whoever stole one has counted it in
+ * its scope's sparks_running */
+static void sparks_drop(long bottom) {
+	struct worker *worker = worker_curr;
+	struct spark spark;
+	while (sparks_bottom() > bottom && deque_pop(&worker->deque, &spark)) {
+		thunk_release(spark.thunk);
+		worker->sparks_fizzled++;
+	}
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	while (__atomic_load_n(&worker->deque.stealing, __ATOMIC_ACQUIRE) != 0) {
+		sched_yield();
+	}
+}
+
+static int spark_steal(struct worker *thief, struct spark *spark) {
+	size_t i;
+	for (i = 1; i < workers_len; i++) {
+		struct worker *victim = workers[(thief->index + i) % workers_len];
+		int is_stolen;
+		__atomic_add_fetch(&victim->deque.stealing, 1, __ATOMIC_SEQ_CST);
+		is_stolen = deque_steal(&victim->deque, spark);
+		if (is_stolen && spark->scope != NULL) {
+			__atomic_add_fetch(&spark->scope->sparks_running, 1, __ATOMIC_RELAXED);
+		}
+		__atomic_sub_fetch(&victim->deque.stealing, 1, __ATOMIC_RELEASE);
+		if (is_stolen) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* evaluates a stolen spark, unless a worker already has. the sparks it makes
+ * may be of things in its scope, so are dropped before the scope is let go */
+static void spark_run(struct worker *worker, struct spark *spark) {
+	long bottom = sparks_bottom();
+	worker->sparks_stolen++;
+	if (thunk_claim(spark->thunk)) {
+		thunk_eval_claimed(spark->thunk);
+	} else {
+		worker->sparks_fizzled++;
+	}
+	thunk_release(spark->thunk);
+	sparks_drop(bottom);
+	if (spark->scope != NULL) {
+		__atomic_sub_fetch(&spark->scope->sparks_running, 1, __ATOMIC_RELEASE);
+	}
+}
+
+static void *worker_run(void *arg) {
+	struct worker *worker = arg;
+	struct timespec nap   = {0, 50000};
+	size_t idle           = 0;
+	char stack_marker;
+	worker_curr     = worker;
+	eval_stats_curr = &worker->eval_stats;
+	stack_limit     = (uintptr_t)&stack_marker - RACC_WORKER_STACK_SIZE +
+	              RACC_STACK_RED_ZONE;
+	for (;;) {
+		struct spark spark;
+		/* counted as running before it can claim anything */
+		__atomic_add_fetch(&workers_running, 1, __ATOMIC_SEQ_CST);
+		if (spark_steal(worker, &spark)) {
+			spark_run(worker, &spark);
+			idle = 0;
+		} else {
+			idle++;
+		}
+		__atomic_sub_fetch(&workers_running, 1, __ATOMIC_SEQ_CST);
+		if (idle > 64) {
+			nanosleep(&nap, NULL);
+		} else if (idle > 0) {
+			sched_yield();
+		}
+	}
+	return NULL;
+}
+
+static void workers_start(void) {
+	char *workers_env = getenv("RACC_WORKERS");
+	long len          = workers_env != NULL ? atol(workers_env)
+	                                        : sysconf(_SC_NPROCESSORS_ONLN);
+	pthread_attr_t attr;
+	size_t i;
+	workers_len = len > 1 ? (size_t)len : 1;
+	workers     = calloc(workers_len, sizeof(struct worker *));
+	workers[0]  = &worker_main;
+	/* all there before any starts stealing */
+	for (i = 1; i < workers_len; i++) {
+		workers[i]        = calloc(1, sizeof(struct worker));
+		workers[i]->index = i;
+	}
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, RACC_WORKER_STACK_SIZE);
+	for (i = 1; i < workers_len; i++) {
+		if (pthread_create(&workers[i]->thread, &attr, worker_run, workers[i]) !=
+		    0) {
+			fprintf(stderr, "Couldn't start worker %lu\n", (unsigned long)i);
+			exit(1);
+		}
+	}
+	pthread_attr_destroy(&attr);
+}
+
+/* the thunk is retained until run or dropped */
+void spark(struct thunk *thunk) {
+	struct spark spark;
+	if (workers_len == 0) {
+		workers_start();
+	}
+	thunk = thunk_skip_indirections(thunk);
+	if (workers_len == 1 || thunk_state(thunk) != THUNK_UNEVALUATED) {
+		return;
+	}
+	spark.thunk = thunk;
+	spark.scope = NULL;
+	if (thunk->region != NULL && region_is_scope(thunk->region)) {
+		spark.scope = thunk->region;
+	}
+	thunk_retain(thunk);
+	if (!deque_push(&worker_curr->deque, &spark)) {
+		thunk_release(thunk);
+		worker_curr->sparks_fizzled++;
+		return;
+	}
+	worker_curr->sparks_created++;
+}
+
+int spark_wanted(void) {
+	struct spark_deque *deque = &worker_curr->deque;
+	long waiting;
+	long idle;
+	if (workers_len == 0) {
+		workers_start();
+	}
+	waiting = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) -
+	          __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+	idle = (long)workers_len -
+	       (long)__atomic_load_n(&workers_running, __ATOMIC_RELAXED);
+	return waiting < idle;
+}
+
+static void sparks_print(void) {
+	size_t created = 0;
+	size_t stolen  = 0;
+	size_t fizzled = 0;
+	size_t i;
+	for (i = 0; i < workers_len; i++) {
+		created += workers[i]->sparks_created;
+		stolen += workers[i]->sparks_stolen;
+		fizzled += workers[i]->sparks_fizzled;
+	}
+	fprintf(stderr, "workers:            %lu\n", (unsigned long)workers_len);
+	fprintf(stderr, "sparks created:     %lu\n", (unsigned long)created);
+	fprintf(stderr, "sparks stolen:      %lu\n", (unsigned long)stolen);
+	fprintf(stderr, "sparks fizzled:     %lu\n", (unsigned long)fizzled);
+}
+
+#else
+
+static void *thunk_wait(struct thunk *thunk) {
+	(void)thunk;
+	thunk_loop(); /* forcing itself, it would never finish */
+	return NULL;
+}
+
+#endif
+
+/* ========== GARBAGE COLLECTION ========== */
+
+#ifdef RACC_GC_COPYING
+
+/* the nursery allocates into blocks of its own. once RACC_GC_NURSERY_SIZE of
+ * them are full, or as many as the C stacks last scanned took if more, a minor
+ * collection copies what is still reachable in them to old blocks, freeing the
+ * rest. once the old blocks reach twice what was live after the last major
+ * collection, the next collection is a major one, which copies everything
+ * reachable.
+ *
+ * generated code holds heap pointers in C variables, which can't be found
+ * precisely, so the C stacks are scanned conservatively: a block any word on
+ * them could point into is pinned, staying where it is and becoming old whole.
+ * everything else is found precisely, from the layouts in object headers, and
+ * moved. old objects written to are remembered, so a minor collection finds
+ * what they point to in the nursery without scanning every old block */
+
+#define GC_BLOCKS_MAX (RACC_GC_HEAP_MAX / RACC_GC_BLOCK_SIZE)
+#define GC_NURSERY_BLOCKS (RACC_GC_NURSERY_SIZE / RACC_GC_BLOCK_SIZE)
+
+/* the low bits of an object's header, above which is its layout */
+#define GC_ARGS ((uintptr_t)1)       /* an args array, its length above */
+#define GC_FORWARDED ((uintptr_t)2)  /* moved, its new address above */
+#define GC_REMEMBERED ((uintptr_t)4) /* in the remembered set */
+#define GC_FLAGS ((uintptr_t)7)
+
+#define gc_header(OBJECT) (((uintptr_t *)(OBJECT))[-1])
+
+enum gc_space { GC_FREE, GC_NURSERY, GC_OLD };
+
+struct gc_block {
+	struct gc_block *next_free;
+	char *top;  /* end of the objects in it */
+	char *scan; /* objects before this are scanned, while collecting */
+	unsigned char space;
+	unsigned char is_from;      /* being collected */
+	unsigned char is_discarded; /* free, and its pages given back */
+};
+
+struct gc_stats gc_stats;
+
+static char *heap;
+static struct gc_block *blocks;
+static size_t blocks_len; /* blocks ever used, those after are untouched */
+static struct gc_block *blocks_free;
+static size_t blocks_free_kept; /* free blocks whose pages are kept */
+static size_t blocks_old;
+static size_t blocks_old_max; /* the next collection is major past this */
+
+static struct gc_block *nursery;
+static char *nursery_top;
+static char *nursery_end;
+static size_t nursery_blocks;
+/* at least the size of the stacks, so time scanning them is paid for in what
+ * is allocated between collections */
+static size_t nursery_blocks_max;
+
+static struct gc_block *copy_block; /* evacuated objects go in this */
+static struct gc_block **scan_list; /* blocks with objects to scan */
+static size_t scan_len;
+static size_t scan_cap;
+
+static void **remembered;
+static size_t remembered_len;
+static size_t remembered_cap;
+
+static char *stack_top;
+static struct thunk **gc_roots;
+
+#define block_of(PTR) (&blocks[((char *)(PTR)-heap) / RACC_GC_BLOCK_SIZE])
+#define block_data(BLOCK) (heap + ((BLOCK)-blocks) * RACC_GC_BLOCK_SIZE)
+#define block_end(BLOCK) (block_data(BLOCK) + RACC_GC_BLOCK_SIZE)
+
+static int in_heap(uintptr_t word) {
+	return word >= (uintptr_t)heap &&
+	       word < (uintptr_t)heap + blocks_len * RACC_GC_BLOCK_SIZE;
+}
+
+static void gc_out_of_memory(void) {
+	fprintf(stderr, "Out of memory for the heap\n");
+	exit(1);
+}
+
+void gc_init(void *top, struct thunk **roots) {
+	heap   = mmap(NULL,
+	              RACC_GC_HEAP_MAX,
+	              PROT_READ | PROT_WRITE,
+	              MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+	              -1,
+	              0);
+	blocks = calloc(GC_BLOCKS_MAX, sizeof(struct gc_block));
+	if (heap == MAP_FAILED || blocks == NULL) {
+		gc_out_of_memory();
+	}
+	stack_top      = top;
+	gc_roots       = roots;
+	blocks_old_max     = 2 * GC_NURSERY_BLOCKS;
+	nursery_blocks_max = GC_NURSERY_BLOCKS;
+}
+
+static struct gc_block *block_take(enum gc_space space) {
+	struct gc_block *block = blocks_free;
+	if (block == NULL) {
+		if (blocks_len == GC_BLOCKS_MAX) {
+			gc_out_of_memory();
+		}
+		block = &blocks[blocks_len++];
+	} else {
+		blocks_free = block->next_free;
+		if (!block->is_discarded) {
+			blocks_free_kept--;
+		}
+	}
+	block->space = space;
+	block->top   = block_data(block);
+	gc_stats.blocks++;
+	if (gc_stats.blocks > gc_stats.blocks_max) {
+		gc_stats.blocks_max = gc_stats.blocks;
+	}
+	return block;
+}
+
+/* keeps the pages of a nursery's worth of free blocks, giving back the rest,
+ * so memory use follows what is live */
+static void block_free(struct gc_block *block) {
+	block->space        = GC_FREE;
+	block->is_from      = 0;
+	block->is_discarded = blocks_free_kept >= nursery_blocks_max;
+	if (block->is_discarded) {
+		madvise(block_data(block), RACC_GC_BLOCK_SIZE, MADV_DONTNEED);
+	} else {
+		blocks_free_kept++;
+	}
+	block->next_free = blocks_free;
+	blocks_free      = block;
+	gc_stats.blocks--;
+}
+
+/* object sizes leave out the header */
+static size_t object_size(uintptr_t header) {
+	if ((header & GC_ARGS) != 0) {
+		return (header >> 3) * sizeof(struct thunk *);
+	}
+	return size_aligned(
+		((const struct object_layout *)(header & ~GC_FLAGS))->size);
+}
+
+static void scan_push(struct gc_block *block) {
+	if (scan_len == scan_cap) {
+		scan_cap  = scan_cap == 0 ? 64 : 2 * scan_cap;
+		scan_list = realloc(scan_list, scan_cap * sizeof(struct gc_block *));
+	}
+	block->scan           = block_data(block);
+	scan_list[scan_len++] = block;
+}
+
+static void thunk_scan(void *object) {
+	struct thunk *thunk = object;
+	switch (thunk_state(thunk)) {
+	case THUNK_UNEVALUATED:
+	case THUNK_BLACKHOLE: gc_evacuate((void **)&thunk->v.closure); break;
+	case THUNK_INDIRECTION: gc_evacuate(&thunk->v.value); break;
+	case THUNK_EVALUATED:
+		if (thunk_info(thunk)->kind != VALUE_IMMEDIATE) {
+			gc_evacuate(&thunk->v.value);
+		}
+		break;
+	}
+}
+
+/* thunks are scanned by their state, the rest by their layout's fields */
+static const struct object_layout layout_thunk = {
+	.size = sizeof(struct thunk),
+};
+static const struct field_layout fields_closure[] = {
+	{offsetof(struct closure, args), NULL},
+};
+static const struct object_layout layout_closure = {
+	.size       = sizeof(struct closure),
+	.fields_len = 1,
+	.fields     = fields_closure,
+};
+static const struct field_layout fields_pap[] = {
+	{offsetof(struct pap, args), NULL},
+};
+static const struct object_layout layout_pap = {
+	.size       = sizeof(struct pap),
+	.fields_len = 1,
+	.fields     = fields_pap,
+};
+
+void gc_evacuate(void **field) {
+	uintptr_t word = (uintptr_t)*field;
+	uintptr_t tag  = word & DATA_TAG_MASK;
+	char *object   = (char *)(word - tag);
+	uintptr_t header;
+	size_t size;
+	char *copy;
+
+	if ((word & 1) != 0 || !in_heap(word) || !block_of(object)->is_from) {
+		return; /* immediates, static data and objects staying put */
+	}
+	header = gc_header(object);
+	if ((header & GC_FORWARDED) != 0) {
+		*field = (char *)(header & ~GC_FLAGS) + tag;
+		return;
+	}
+	if ((header & ~GC_FLAGS) == (uintptr_t)&layout_thunk &&
+	    thunk_state((struct thunk *)object) == THUNK_INDIRECTION) {
+		/* nothing needs an indirection once its users point past it */
+		*field = ((struct thunk *)object)->v.value;
+		gc_evacuate(field);
+		return;
+	}
+
+	size = sizeof(uintptr_t) + object_size(header);
+	if (copy_block == NULL ||
+	    (size_t)(block_end(copy_block) - copy_block->top) < size) {
+		copy_block = block_take(GC_OLD);
+		scan_push(copy_block);
+	}
+	copy = copy_block->top;
+	copy_block->top += size;
+	memcpy(copy, object - sizeof(uintptr_t), size);
+	copy += sizeof(uintptr_t);
+	gc_header(copy)   = header & ~GC_REMEMBERED;
+	gc_header(object) = (uintptr_t)copy | GC_FORWARDED;
+	*field            = copy + tag;
+}
+
+static void object_scan(char *object) {
+	uintptr_t header = gc_header(object);
+	const struct object_layout *layout;
+	size_t i;
+	if ((header & GC_ARGS) != 0) {
+		for (i = 0; i < header >> 3; i++) {
+			gc_evacuate(&((void **)object)[i]);
+		}
+		return;
+	}
+	layout = (const struct object_layout *)(header & ~GC_FLAGS);
+	if (layout == &layout_thunk) {
+		thunk_scan(object);
+		return;
+	}
+	for (i = 0; i < layout->fields_len; i++) {
+		gc_evacuate((void **)(object + layout->fields[i].offset));
+	}
+}
+
+/* scans every object pinned or evacuated, which evacuates more, until there
+ * is nothing left to scan */
+static void scan_blocks(void) {
+	size_t i;
+	for (i = 0; i < scan_len; i++) {
+		struct gc_block *block = scan_list[i];
+		while (block->scan < block->top) {
+			char *object = block->scan + sizeof(uintptr_t);
+			block->scan  = object + object_size(gc_header(object));
+			object_scan(object);
+		}
+	}
+}
+
+static void pin(uintptr_t word) {
+	struct gc_block *block;
+	if (!in_heap(word) || !block_of(word)->is_from) {
+		return;
+	}
+	block          = block_of(word);
+	block->is_from = 0;
+	block->space   = GC_OLD;
+	scan_push(block);
+}
+
+/* the bytes of the C stacks scanned by the last collection */
+static size_t stacks_size;
+
+static void pin_range(void *start, void *end) {
+	uintptr_t *word =
+		(uintptr_t *)((uintptr_t)start & ~(sizeof(uintptr_t) - 1));
+	stacks_size += (char *)end - (char *)word;
+	for (; (void *)word < end; word++) {
+		pin(*word);
+		pin(*word - 1); /* just past an object ending its block */
+	}
+}
+
+/* pins the blocks anything on the C stacks could point into, from sp up and
+ * then each stack a segment was switched to from */
+static void pin_stacks(char *sp) {
+	struct stack_segment *segment = segment_curr;
+	stacks_size                   = 0;
+	pin_range(sp,
+	          segment == NULL ? stack_top
+	                          : segment->base + RACC_STACK_SEGMENT_SIZE);
+	for (; segment != NULL; segment = segment->prev) {
+		pin_range(segment, segment + 1); /* the caller's registers */
+		pin_range(segment->caller_sp,
+		          segment->prev == NULL
+		            ? stack_top
+		            : segment->prev->base + RACC_STACK_SEGMENT_SIZE);
+	}
+}
+
+/* not inlined, so every frame which could hold a heap pointer is above it */
+static __attribute__((noinline)) void gc_collect(void) {
+	ucontext_t registers;
+	int is_major = blocks_old >= blocks_old_max;
+	struct thunk **root;
+	size_t i;
+
+	getcontext(&registers); /* callee saved registers, onto the stack */
+	for (i = 0; i < blocks_len; i++) {
+		blocks[i].is_from = blocks[i].space == GC_NURSERY ||
+		                    (is_major && blocks[i].space == GC_OLD);
+	}
+	scan_len   = 0;
+	copy_block = NULL;
+
+	/* nothing moves until every pinned block is known */
+	pin_stacks((char *)&registers);
+	for (i = 0; i < remembered_len; i++) {
+		gc_header(remembered[i]) &= ~GC_REMEMBERED;
+		if (!is_major) {
+			object_scan(remembered[i]);
+		}
+	}
+	remembered_len = 0;
+	for (root = gc_roots; *root != NULL; root++) {
+		thunk_scan(*root);
+	}
+	scan_blocks();
+
+	blocks_old = 0;
+	for (i = 0; i < blocks_len; i++) {
+		if (blocks[i].is_from) {
+			block_free(&blocks[i]);
+		} else if (blocks[i].space == GC_OLD) {
+			blocks_old++;
+		}
+	}
+	nursery        = NULL;
+	nursery_top    = NULL;
+	nursery_end    = NULL;
+	nursery_blocks = 0;
+
+	nursery_blocks_max = stacks_size / RACC_GC_BLOCK_SIZE;
+	if (nursery_blocks_max < GC_NURSERY_BLOCKS) {
+		nursery_blocks_max = GC_NURSERY_BLOCKS;
+	}
+	if (is_major) {
+		gc_stats.major++;
+		blocks_old_max = 2 * blocks_old;
+		if (blocks_old_max < 2 * GC_NURSERY_BLOCKS) {
+			blocks_old_max = 2 * GC_NURSERY_BLOCKS;
+		}
 	} else {
-		thunk = arena_push_struct_zero(region->arena, struct thunk);
+		gc_stats.minor++;
+	}
+}
+
+static void *gc_push(size_t size, uintptr_t header) {
+	char *object;
+	size = sizeof(uintptr_t) + size_aligned(size);
+	if ((size_t)(nursery_end - nursery_top) < size) {
+		if (size > RACC_GC_BLOCK_SIZE) {
+			fprintf(stderr, "Object too large for a heap block\n");
+			exit(1);
+		}
+		if (nursery != NULL) {
+			nursery->top = nursery_top;
+		}
+		if (nursery_blocks == nursery_blocks_max) {
+			gc_collect();
+		}
+		nursery = block_take(GC_NURSERY);
+		nursery_blocks++;
+		nursery_top = block_data(nursery);
+		nursery_end = block_end(nursery);
 	}
+	object = nursery_top;
+	nursery_top += size;
+	memset(object, 0, size);
+	*(uintptr_t *)object = header;
+	return object + sizeof(uintptr_t);
+}
+
+void *gc_alloc(const struct object_layout *layout) {
+	return gc_push(layout->size, (uintptr_t)layout);
+}
+
+static struct thunk **gc_alloc_args(size_t args_len) {
+	return gc_push(args_len * sizeof(struct thunk *),
+	               ((uintptr_t)args_len << 3) | GC_ARGS);
+}
+
+void gc_remember(void *object) {
+	if (!in_heap((uintptr_t)object) || block_of(object)->space != GC_OLD ||
+	    (gc_header(object) & GC_REMEMBERED) != 0) {
+		return;
+	}
+	gc_header(object) |= GC_REMEMBERED;
+	if (remembered_len == remembered_cap) {
+		remembered_cap = remembered_cap == 0 ? 256 : 2 * remembered_cap;
+		remembered     = realloc(remembered, remembered_cap * sizeof(void *));
+	}
+	remembered[remembered_len++] = object;
+}
+
+void gc_stats_print(void) {
+	fprintf(stderr, "minor collections: %lu\n", gc_stats.minor);
+	fprintf(stderr, "major collections: %lu\n", gc_stats.major);
+	fprintf(stderr, "heap blocks max:   %lu\n", gc_stats.blocks_max);
+}
+
+/* objects go in the heap, described by their layout */
+#define object_alloc(REGION, LAYOUT, SIZE) ((void)(REGION), gc_alloc(LAYOUT))
+#else
+/* objects go in region, or are malloc'd without one */
+#define object_alloc(REGION, LAYOUT, SIZE)                                     \
+	((REGION) == NULL ? calloc(1, SIZE) : region_push(REGION, SIZE))
+#endif
+
+/* ========== CLOSURES/THUNKS ========== */
+
+void *_thunk_eval(struct thunk *thunk) {
+	thunk = thunk_skip_indirections(thunk);
+	if (thunk_state(thunk) == THUNK_EVALUATED) {
+		return thunk->v.value;
+	}
+	if (!thunk_claim(thunk)) {
+		return thunk_wait(thunk);
+	}
+	return thunk_eval_claimed(thunk);
+}
+
+struct thunk *_thunk_follow(struct thunk **field) {
+#ifdef RACC_GC_COPYING
+	/* writing the field would need its object remembered, and collections
+	 * point past indirections anyway */
+	return thunk_skip_indirections(*field);
+#else
+	*field = thunk_skip_indirections(*field);
+	return *field;
+#endif
+}
+
+static struct thunk *thunk_alloc(struct region *region) {
+	struct thunk *thunk =
+		object_alloc(region, &layout_thunk, sizeof(struct thunk));
 	thunk->region = region;
+#ifndef RACC_GC_COPYING
 	region_retain(region);
+#endif
 	return thunk;
 }
 
 struct thunk *thunk_closure(struct closure *closure,
                             struct region *region,
-                            void *(value_copy)(void *, struct region *region)) {
+                            const struct thunk_info *info) {
 	struct thunk *thunk;
-	thunk             = thunk_alloc(region);
-	thunk->evaluated  = 0;
-	thunk->value_copy = value_copy;
-	thunk->closure    = closure;
+	thunk            = thunk_alloc(region);
+	thunk->info      = thunk_info_state(info, THUNK_UNEVALUATED);
+	thunk->v.closure = closure;
 	return thunk;
 }
 
-struct thunk *thunk_lit(void *value,
-                        struct region *region,
-                        void *(value_copy)(void *, struct region *region)) {
+struct thunk *
+thunk_lit(void *value, struct region *region, const struct thunk_info *info) {
 	struct thunk *thunk;
-	thunk             = thunk_alloc(region);
-	thunk->evaluated  = 1;
-	thunk->value_copy = value_copy;
-	thunk->value      = value;
+	thunk          = thunk_alloc(region);
+	thunk->info    = thunk_info_state(info, THUNK_EVALUATED);
+	thunk->v.value = value;
 	return thunk;
 }
 
-static struct closure *closure_copy(struct closure *closure) {
-	struct closure *result;
+#ifdef RACC_GC_COPYING
+/* the collector keeps the thunk for as long as anything can reach it */
+struct thunk *thunk_copy(struct thunk *thunk, struct region *region) {
+	(void)region;
+	return thunk_skip_indirections(thunk);
+}
+#else
+static void *pap_copy(struct pap *, struct region *);
+static void *value_copy(const struct thunk_info *, void *, struct region *);
+
+/* copies data one level deep, by its constructor's layout. its thunks become
+ * lazy copies, and its strict data fields copies, as they are evaluated */
+static void *
+data_copy(const struct thunk_info *info, void *value, struct region *region) {
+	uintptr_t tag = (uintptr_t)value & DATA_TAG_MASK;
+	const struct object_layout *layout;
+	char *data;
+	char *copy;
 	size_t i;
-	result           = calloc(1, sizeof(struct closure));
-	result->fn_arity = closure->fn_arity;
-	result->fn       = closure->fn;
-	result->args_len = closure->args_len;
-	result->args     = calloc(result->fn_arity, sizeof(struct thunk *));
-	for (i = 0; i < result->args_len; i++) {
-		result->args[i] = closure->args[i]; /* we can resuse the thunks */
+	if (data_is_nullary(value)) {
+		return value; /* immediate, so shared */
 	}
-	return result;
+	data   = data_untagged_any(value);
+	layout = info->constructors[data_constructor(data)];
+	copy   = region_push(region, layout->size);
+	memcpy(copy, data, layout->size);
+	for (i = 0; i < layout->fields_len; i++) {
+		const struct field_layout *field = &layout->fields[i];
+		void **param                     = (void **)(copy + field->offset);
+		*param = field->info == NULL ? thunk_copy(*param, region)
+		                             : value_copy(field->info, *param, region);
+	}
+	return copy + tag;
 }
 
-struct thunk *thunk_apply(struct thunk *thunk_closure,
-                          struct thunk *thunk_arg) {
-	struct thunk *result;
-	result = thunk_copy(thunk_closure, thunk_arg->region);
-	result->closure->args[result->closure->args_len] = thunk_arg;
-	result->closure->args_len++;
-	return result;
+static void *
+value_copy(const struct thunk_info *info, void *value, struct region *region) {
+	switch (info->kind) {
+	case VALUE_FN: return pap_copy(value, region);
+	case VALUE_DATA: return data_copy(info, value, region);
+	default: return value;
+	}
+}
+
+/* the closure of a lazy copy. copies the value one level deep, its fields
+ * becoming lazy copies in turn */
+static void *thunk_copy_forced(struct thunk **args, struct region *region) {
+	struct thunk *from = args[0];
+	void *value        = thunk_eval(from, void *);
+	value              = value_copy(thunk_info(from), value, region);
+	region_release(from->region);
+	return value;
 }
 
 struct thunk *thunk_copy(struct thunk *thunk, struct region *region) {
 	struct thunk *result;
+	thunk = thunk_skip_indirections(thunk);
+	if (region_outlives(thunk->region, region)) {
+		return thunk; /* e.g. CAFs, or anything in an enclosing letregion */
+	}
+	if (!region_is_scope(thunk->region)) {
+		/* its region is kept alive until the copy is first forced */
+		region_retain(thunk->region);
+		return thunk_call(
+			thunk_copy_forced, region, thunk_info(thunk), 1, thunk);
+	}
+	/* a letregion is reset on exit whatever its reference count, so can't be
+	 * waited on */
 	if (region == NULL) {
 		result = calloc(1, sizeof(struct thunk));
 	} else {
-		if (region->arena == NULL) {
-			region->arena = arena_alloc();
-		}
 		result = region_push_struct(region, struct thunk);
 	}
-	result->region     = region;
-	result->evaluated  = thunk->evaluated;
-	result->value_copy = thunk->value_copy;
-	if (thunk->evaluated) {
-		result->value = thunk->value_copy(thunk->value, region);
+	result->region = region;
+	if (thunk_state(thunk) == THUNK_EVALUATED) {
+		result->info = thunk_info_state(thunk_info(thunk), THUNK_EVALUATED);
+		result->v.value = value_copy(thunk_info(thunk), thunk->v.value, region);
 	} else {
-		result->closure =
-			thunk->closure == NULL ? NULL : closure_copy(thunk->closure);
+		/* a blackholed copy is evaluated again on its own */
+		result->info = thunk_info_state(thunk_info(thunk), THUNK_UNEVALUATED);
+		result->v.closure = thunk->v.closure; /* closures are immutable */
+#ifdef RACC_PARALLEL
+		/* unless another worker updated it meanwhile, so that was its value */
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (thunk_state(thunk) == THUNK_EVALUATED ||
+		    thunk_state(thunk) == THUNK_INDIRECTION) {
+			return thunk_copy(thunk, region);
+		}
+#endif
 	}
 	return result;
 }
+#endif
 
 void thunk_retain(struct thunk *thunk) { region_retain(thunk->region); }
 
 void thunk_release(struct thunk *thunk) { region_release(thunk->region); }
 
-/* ========== LANGUAGE DEFINED DATA TYPES ========== */
+/* ========== EVAL/APPLY ========== */
 
-void *value_copy_List(void *value, struct region *region) {
-	struct data_List *data = value;
-	struct data_List *copy;
-	if (region->arena == NULL) {
-		region->arena = arena_alloc();
+static struct thunk **args_alloc(size_t args_len, struct region *region) {
+#ifdef RACC_GC_COPYING
+	(void)region;
+	return gc_alloc_args(args_len);
+#else
+	if (region == NULL) {
+		return calloc(args_len, sizeof(struct thunk *));
 	}
-	copy       = region_push_struct(region, struct data_List);
-	copy->type = data->type;
-	if (data->type == DATA_List_Cons) {
-		copy->v.Cons.param_0 = thunk_copy(data->v.Cons.param_0, region);
-		copy->v.Cons.param_1 = thunk_copy(data->v.Cons.param_1, region);
+	return region_push(region, args_len * sizeof(struct thunk *));
+#endif
+}
+
+static struct closure *closure_new(void *(*fn)(struct thunk **,
+                                               struct region *),
+                                   struct thunk **args,
+                                   struct region *region) {
+	struct closure *closure =
+		object_alloc(region, &layout_closure, sizeof(struct closure));
+	closure->fn   = fn;
+	closure->args = args;
+	return closure;
+}
+
+static struct pap *pap_new(void *(*fn)(struct thunk **, struct region *),
+                           size_t arity,
+                           size_t args_len,
+                           struct region *region) {
+	struct pap *pap = object_alloc(region, &layout_pap, sizeof(struct pap));
+	pap->fn       = fn;
+	pap->arity    = arity;
+	pap->args_len = args_len;
+	pap->args     = args_alloc(arity, region);
+	return pap;
+}
+
+struct thunk *thunk_call(void *(*fn)(struct thunk **, struct region *),
+                         struct region *region,
+                         const struct thunk_info *info,
+                         size_t args_len,
+                         ...) {
+	struct thunk **args = NULL;
+	va_list va;
+	size_t i;
+	if (args_len > 0) {
+		args = args_alloc(args_len, region);
+	}
+	va_start(va, args_len);
+	for (i = 0; i < args_len; i++) {
+		args[i] = va_arg(va, struct thunk *);
+	}
+	va_end(va);
+	return thunk_closure(closure_new(fn, args, region), region, info);
+}
+
+struct thunk *thunk_pap(void *(*fn)(struct thunk **, struct region *),
+                        size_t fn_arity,
+                        struct region *region,
+                        size_t args_len,
+                        ...) {
+	struct pap *pap = pap_new(fn, fn_arity, args_len, region);
+	va_list va;
+	size_t i;
+	assert(args_len < fn_arity);
+	va_start(va, args_len);
+	for (i = 0; i < args_len; i++) {
+		pap->args[i] = va_arg(va, struct thunk *);
+	}
+	va_end(va);
+	return thunk_lit(pap, region, &info_Fn);
+}
+
+static void *(*const apply_fns[RACC_APPLY_MAX + 1])(struct thunk **,
+                                                     struct region *) = {
+	NULL, apply_1, apply_2, apply_3, apply_4, apply_5, apply_6, apply_7, apply_8,
+};
+
+struct thunk *thunk_apply(struct thunk *fn_thunk,
+                          struct region *region,
+                          const struct thunk_info *info,
+                          size_t args_len,
+                          ...) {
+	struct thunk *result = fn_thunk;
+	va_list va;
+	assert(args_len > 0);
+	va_start(va, args_len);
+	while (args_len > 0) {
+		/* [fn_thunk, arg_0, .., arg_n] */
+		size_t chunk_len = args_len > RACC_APPLY_MAX ? RACC_APPLY_MAX : args_len;
+		struct thunk **args;
+		size_t i;
+		args    = args_alloc(chunk_len + 1, region);
+		args[0] = result;
+		for (i = 0; i < chunk_len; i++) {
+			args[i + 1] = va_arg(va, struct thunk *);
+		}
+		args_len -= chunk_len;
+		result = thunk_closure(closure_new(apply_fns[chunk_len], args, region),
+		                       region,
+		                       args_len > 0 ? &info_Fn : info);
+	}
+	va_end(va);
+	return result;
+}
+
+/* applies args to pap, calling the function directly once it is saturated.
+ * returns a new pap when undersaturated */
+void *pap_apply(struct pap *pap,
+                size_t args_len,
+                struct thunk **args,
+                struct region *region) {
+	size_t args_needed = pap->arity - pap->args_len;
+	struct thunk **call_args;
+	void *result;
+	size_t i;
+
+	if (args_len < args_needed) {
+		struct pap *result_pap =
+			pap_new(pap->fn, pap->arity, pap->args_len + args_len, region);
+		for (i = 0; i < pap->args_len; i++) {
+			result_pap->args[i] = pap->args[i];
+		}
+		for (i = 0; i < args_len; i++) {
+			result_pap->args[pap->args_len + i] = args[i];
+		}
+		return result_pap;
+	}
+
+	if (pap->args_len == 0) {
+		call_args = args; /* nothing to prepend, call straight through */
+	} else {
+		call_args = args_alloc(pap->arity, region);
+		for (i = 0; i < pap->args_len; i++) {
+			call_args[i] = pap->args[i];
+		}
+		for (i = 0; i < args_needed; i++) {
+			call_args[pap->args_len + i] = args[i];
+		}
+	}
+	result = trampoline(pap->fn, call_args, region);
+
+	if (args_len == args_needed) {
+		return result;
+	}
+	/* oversaturated, so the result is itself a function */
+	return pap_apply(
+		result, args_len - args_needed, &args[args_needed], region);
+}
+
+#ifndef RACC_GC_COPYING
+static void *pap_copy(struct pap *pap, struct region *region) {
+	struct pap *copy;
+	size_t i;
+	copy = pap_new(pap->fn, pap->arity, pap->args_len, region);
+	for (i = 0; i < pap->args_len; i++) {
+		copy->args[i] = thunk_copy(pap->args[i], region);
 	}
 	return copy;
 }
+#endif
 
-struct data_List _data_List_Null = {
-	.type = DATA_List_Null,
+const struct thunk_info info_Fn = {.kind = VALUE_FN};
+
+#define APPLY_N(N)                                                             \
+	void *apply_##N(struct thunk **args, struct region *region) {                \
+		return pap_apply(thunk_eval(args[0], struct pap *), N, &args[1], region);  \
+	}
+
+APPLY_N(1)
+APPLY_N(2)
+APPLY_N(3)
+APPLY_N(4)
+APPLY_N(5)
+APPLY_N(6)
+APPLY_N(7)
+APPLY_N(8)
+
+/* ========== TAIL CALLS ========== */
+
+/* the call a function asked for by returning tail_call(..). there is only one
+ * per worker as it is consumed by the trampoline before anything else runs */
+static per_thread struct closure tail_call_pending;
+
+void *tail_call(void *(*fn)(struct thunk **, struct region *),
+                struct region *region,
+                size_t args_len,
+                ...) {
+	va_list va;
+	size_t i;
+	tail_call_pending.fn   = fn;
+	tail_call_pending.args = NULL;
+	if (args_len > 0) {
+		tail_call_pending.args = args_alloc(args_len, region);
+	}
+	va_start(va, args_len);
+	for (i = 0; i < args_len; i++) {
+		tail_call_pending.args[i] = va_arg(va, struct thunk *);
+	}
+	va_end(va);
+	return &tail_call_pending;
+}
+
+void *tail_eval(struct thunk *thunk) {
+	tail_eval_pending = thunk;
+	return &tail_eval_pending;
+}
+
+/* makes tail calls, but leaves a tail_eval(..) for the caller */
+static void *trampoline_run(void *(*fn)(struct thunk **, struct region *),
+                            struct thunk **args,
+                            struct region *region) {
+	void *result = fn(args, region);
+	while (result == &tail_call_pending) {
+		result = tail_call_pending.fn(tail_call_pending.args, region);
+	}
+	return result;
+}
+
+void *trampoline(void *(*fn)(struct thunk **, struct region *),
+                 struct thunk **args,
+                 struct region *region) {
+	void *result = trampoline_run(fn, args, region);
+	if (result == &tail_eval_pending) {
+		result = _thunk_eval(tail_eval_pending);
+	}
+	return result;
+}
+
+/* ========== LANGUAGE DEFINED DATA TYPES ========== */
+
+static const struct field_layout fields_Cons[] = {
+	{offsetof(struct data_List, v.Cons.param_0), NULL},
+	{offsetof(struct data_List, v.Cons.param_1), NULL},
 };
+const struct object_layout layout_Cons = {
+	.size       = sizeof(struct data_List),
+	.fields_len = 2,
+	.fields     = fields_Cons,
+};
+static const struct object_layout *const layouts_List[] = {NULL, &layout_Cons};
+
+const struct thunk_info info_List = {
+	.kind         = VALUE_DATA,
+	.constructors = layouts_List,
+};
+
 struct thunk _val_Null = {
-	.evaluated = 1,
-	.closure   = NULL,
-	.value     = &_data_List_Null,
+	.info    = thunk_info_state(&info_List, THUNK_EVALUATED),
+	.v.value = data_nullary(DATA_List_Null),
 };
 struct thunk *val_Null = &_val_Null;
 
-void *fn_Cons(struct thunk **args, struct region *region) {
-	struct data_List *value;
-	if (region == NULL) {
-		value = calloc(1, sizeof(struct data_List));
-	} else {
-		if (region->arena == NULL) {
-			region->arena = arena_alloc();
-		}
-		value = region_push_struct(region, struct data_List);
-	}
+struct data_List *
+fn_Cons_init(struct data_List *value, struct thunk *head, struct thunk *tail) {
 	value->type           = DATA_List_Cons;
-	value->v.Cons.param_0 = args[0];
-	value->v.Cons.param_1 = args[1];
+	value->v.Cons.param_0 = head;
+	value->v.Cons.param_1 = tail;
 	return value;
 }
-struct closure _closure_Cons = {
-	.fn_arity = 2,
+
+void *fn_Cons(struct thunk **args, struct region *region) {
+	struct data_List *value =
+		object_alloc(region, &layout_Cons, sizeof(struct data_List));
+	return fn_Cons_init(value, args[0], args[1]);
+}
+struct pap _pap_Cons = {
+	.arity    = 2,
 	.args_len = 0,
 	.fn       = fn_Cons,
 	.args     = NULL,
 };
-struct closure *closure_Cons = &_closure_Cons;
+struct thunk _val_Cons = {
+	.region  = &r_global,
+	.info    = thunk_info_state(&info_Fn, THUNK_EVALUATED),
+	.v.value = &_pap_Cons,
+};
+struct thunk *val_Cons = &_val_Cons;
 
 /* ========== LANGUAGE DEFINED FUNCTIONS ========== */
 
-void *value_copy_Int(void *value, struct region *region) {
-	(void)region;
-	return (int)value;
-}
-
-void *value_copy_Char(void *value, struct region *region) {
-	(void)region;
-	return (char)value;
-}
-
-void *value_copy_Bool(void *value, struct region *region) {
-	(void)region;
-	return (char)value;
-}
+const struct thunk_info info_Int  = {.kind = VALUE_IMMEDIATE};
+const struct thunk_info info_Char = {.kind = VALUE_IMMEDIATE};
+const struct thunk_info info_Bool = {.kind = VALUE_IMMEDIATE};
 
 void *fn_add(struct thunk **args, struct region *region) {
 	(void)region; /* we don't need to allocate */
@@ -214,32 +1765,36 @@ void *fn_div(struct thunk **args, struct region *region) {
 	return v_0 / v_1;
 }
 
-struct closure _closure_add = {
-	.fn_arity = 2,
-	.args_len = 0,
-	.fn       = fn_add,
-	.args     = NULL,
-};
-struct closure _closure_sub = {
-	.fn_arity = 2,
-	.args_len = 0,
-	.fn       = fn_sub,
-	.args     = NULL,
-};
-struct closure _closure_mul = {
-	.fn_arity = 2,
-	.args_len = 0,
-	.fn       = fn_mul,
-	.args     = NULL,
-};
-struct closure _closure_div = {
-	.fn_arity = 2,
-	.args_len = 0,
-	.fn       = fn_div,
-	.args     = NULL,
-};
+#define BUILTIN_FN(NAME)                                                       \
+	struct pap _pap_##NAME = {                                                   \
+		.arity    = 2,                                                             \
+		.args_len = 0,                                                             \
+		.fn       = fn_##NAME,                                                     \
+		.args     = NULL,                                                          \
+	};                                                                           \
+	struct thunk _val_##NAME = {                                                 \
+		.region  = &r_global,                                                      \
+		.info    = thunk_info_state(&info_Fn, THUNK_EVALUATED),                    \
+		.v.value = &_pap_##NAME,                                                   \
+	};                                                                           \
+	struct thunk *val_##NAME = &_val_##NAME;
+
+BUILTIN_FN(add)
+BUILTIN_FN(sub)
+BUILTIN_FN(mul)
+BUILTIN_FN(div)
+
+void *fn_par(struct thunk **args, struct region *region) {
+	(void)region; /* we don't need to allocate */
+	spark(args[0]);
+	return tail_eval(args[1]);
+}
+
+void *fn_seq(struct thunk **args, struct region *region) {
+	(void)region; /* we don't need to allocate */
+	(void)thunk_eval(args[0], void *);
+	return tail_eval(args[1]);
+}
 
-struct closure *closure_add = &_closure_add;
-struct closure *closure_sub = &_closure_sub;
-struct closure *closure_mul = &_closure_mul;
-struct closure *closure_div = &_closure_div;
+BUILTIN_FN(par)
+BUILTIN_FN(seq)
@@ -66,7 +66,8 @@ struct type {
 struct dec_type {
 	char *name;
 	struct type *type;
-	char *region_var;
+	char *region_var; /* inferred when not given */
+	int letregion;    /* evaluated in a region of its own, freed on return */
 };
 
 struct dec_class {
@@ -77,7 +78,8 @@ struct dec_class {
 
 struct dec_constructor {
 	char *name;
-	struct list *type_params; /* list of struct type */
+	struct list *type_params;   /* list of struct type */
+	struct list *strict_params; /* list of size_t, 1 for params marked ! */
 	size_t source_index;
 };
 
@@ -15,6 +15,9 @@
 #include <stdlib.h>
 #include <string.h>
 
+/* constructors with fields which pointer tags tell apart, as in base.h */
+#define DATA_TAGS_MAX 3
+
 typedef size_t vid; /* var id */
 typedef size_t rid; /* region id */
 
@@ -22,6 +25,24 @@ struct value {
 	struct dec_type *dec_type;
 	struct list *def_values;
 	struct list *thunks_to_release;
+	char *strict_params; /* per param, whether every call forces it */
+	char *unique_params; /* per param, whether what calls pass is never shared */
+	int is_result_unique;
+	int has_worker;
+	int is_costly; /* whether a call can recurse, taking unbounded time */
+};
+
+/* a param a worker takes unboxed, bound to a variable of its pattern */
+struct worker_var {
+	vid vid;
+	struct type *type;
+};
+
+/* data matched by a case which nothing else refers to, so can be built over by
+ * the same constructor rather than allocating */
+struct reuse_cell {
+	char *constructor_name;
+	vid vid;
 };
 
 struct code_generator {
@@ -32,7 +53,23 @@ struct code_generator {
 	struct map *values;            /* char* -> struct value* */
 	struct map *identifier_to_rid; /* char* -> rid */
 	struct map *region_var_to_id;  /* char* -> rid */
+	struct map *fn_arities;        /* char* -> size_t, constructors/builtins */
+	struct map *static_exprs;      /* struct expr* -> char* thunk name */
+	struct map *dec_datas;         /* char* -> struct dec_data*, user defined */
+	struct map *constructors;      /* char* -> struct dec_constructor* */
+	struct map *worker_vars;       /* char* -> struct worker_var*, in a case */
+	struct map *owned_fields;      /* char* -> char*, per constructor field */
+	struct list *reuse_cells;      /* struct reuse_cell*, in a worker case */
+	struct list *cafs;             /* char*, top level value thunks */
+	int is_allocating; /* whether the worker being generated uses its region */
+	int is_frame_local; /* whether objects built now go in the C stack frame */
+	int is_sparking;    /* whether the program uses par, so thunks built in a
+	                     * frame can be evaluated after it returns */
+	enum opt_level opt_level;
+	enum gc_mode gc_mode;
+	enum par_mode par_mode;
 	rid rid_state;
+	size_t static_state;
 };
 
 static char *translate_type_name(char *fn_name) {
@@ -49,6 +86,12 @@ static char *translate_identifier_name(char *fn_name) {
 	if (strcmp(fn_name, "-") == 0) {
 		return "sub";
 	}
+	if (strcmp(fn_name, "*") == 0) {
+		return "mul";
+	}
+	if (strcmp(fn_name, "/") == 0) {
+		return "div";
+	}
 	if (strcmp(fn_name, "[]") == 0) {
 		return "Null";
 	}
@@ -58,6 +101,245 @@ static char *translate_identifier_name(char *fn_name) {
 	return fn_name;
 }
 
+/* function typed values are stored as paps */
+static char *translate_info_name(struct type *type) {
+	if (strcmp(type->name, "->") == 0) {
+		return "Fn";
+	}
+	return translate_type_name(type->name);
+}
+
+/* the number of a data type's constructors with and without fields */
+static void count_constructors(struct code_generator *cg,
+                               char *data_type_name,
+                               size_t *with_fields,
+                               size_t *nullary) {
+	struct dec_data *dec_data = map_get_str(cg->dec_datas, data_type_name);
+	*with_fields              = 0;
+	*nullary                  = 0;
+	if (dec_data == NULL) {
+		/* lists */
+		*with_fields = 1;
+		*nullary     = 1;
+		return;
+	}
+	list_for_each(dec_data->dec_constructors,
+	              struct dec_constructor *,
+	              if (list_length(_value->type_params) == 0)(*nullary)++;
+	              else(*with_fields)++;);
+}
+
+/* data types with only nullary constructors are plain C enums */
+static int is_enum_data(struct code_generator *cg, char *data_type_name) {
+	size_t with_fields;
+	size_t nullary;
+	if (map_get_str(cg->dec_datas, data_type_name) == NULL) {
+		return 0;
+	}
+	count_constructors(cg, data_type_name, &with_fields, &nullary);
+	return with_fields == 0;
+}
+
+static char *data_c_type(struct code_generator *cg, char *data_type_name) {
+	char *c_type = arena_push_array_zero(
+		cg->arena, strlen(data_type_name) + sizeof("enum data__type"), char);
+	if (is_enum_data(cg, data_type_name)) {
+		sprintf(c_type, "enum data_%s_type", data_type_name);
+	} else {
+		sprintf(c_type, "struct data_%s*", data_type_name);
+	}
+	return c_type;
+}
+
+/* a nullary constructor's value, an immediate rather than a pointer */
+static char *code_gen_nullary(struct code_generator *cg,
+                              char *data_type_name,
+                              char *constructor_name) {
+	char *value = arena_push_array_zero(
+		cg->arena,
+		strlen(data_type_name) + strlen(constructor_name) +
+			sizeof("data_nullary(DATA__)"),
+		char);
+	if (is_enum_data(cg, data_type_name)) {
+		sprintf(value, "DATA_%s_%s", data_type_name, constructor_name);
+	} else {
+		sprintf(value, "data_nullary(DATA_%s_%s)", data_type_name, constructor_name);
+	}
+	return value;
+}
+
+/* whether pointers to the data type's values carry their constructor */
+static int is_tagged_data(struct code_generator *cg, char *data_type_name) {
+	size_t with_fields;
+	size_t nullary;
+	count_constructors(cg, data_type_name, &with_fields, &nullary);
+	return with_fields > 1 && with_fields <= DATA_TAGS_MAX;
+}
+
+/* the index of a constructor among those of its type with fields */
+static size_t constructor_tag(struct code_generator *cg,
+                              char *data_type_name,
+                              char *constructor_name) {
+	struct dec_data *dec_data = map_get_str(cg->dec_datas, data_type_name);
+	struct list_iter iter     = list_iterate(dec_data->dec_constructors);
+	size_t tag                = 0;
+	while (!list_iter_at_end(&iter)) {
+		struct dec_constructor *dec_constructor = list_iter_next(&iter);
+		if (strcmp(dec_constructor->name, constructor_name) == 0) {
+			break;
+		}
+		if (list_length(dec_constructor->type_params) > 0) {
+			tag++;
+		}
+	}
+	return tag;
+}
+
+/* a pointer to data built by constructor_name, tagged if its type is */
+static char *code_gen_tagged(struct code_generator *cg,
+                             char *data_type_name,
+                             char *constructor_name,
+                             char *data) {
+	char *tagged;
+	if (!is_tagged_data(cg, data_type_name)) {
+		return data;
+	}
+	tagged = arena_push_array_zero(
+		cg->arena, strlen(data) + sizeof("data_tagged(, )") + 20, char);
+	sprintf(tagged,
+	        "data_tagged(%s, %ld)",
+	        data,
+	        constructor_tag(cg, data_type_name, constructor_name));
+	return tagged;
+}
+
+/* checks v_var_id was built by constructor_name, else goes to the next case */
+static void code_gen_constructor_check(struct code_generator *cg,
+                                       vid var_id,
+                                       char *data_type_name,
+                                       char *constructor_name,
+                                       int is_nullary,
+                                       size_t next_case_index) {
+	size_t with_fields;
+	size_t nullary;
+	if (is_nullary) {
+		fprintf(cg->fptr,
+		        "\tif(v_%ld != %s) goto case_%ld;\n",
+		        var_id,
+		        code_gen_nullary(cg, data_type_name, constructor_name),
+		        next_case_index);
+		return;
+	}
+	if (is_tagged_data(cg, data_type_name)) {
+		/* the tag alone tells constructors, nullary ones included, apart */
+		fprintf(cg->fptr,
+		        "\tif(!data_has_tag(v_%ld, %ld)) goto case_%ld;\n",
+		        var_id,
+		        constructor_tag(cg, data_type_name, constructor_name),
+		        next_case_index);
+		return;
+	}
+	count_constructors(cg, data_type_name, &with_fields, &nullary);
+	if (nullary > 0) {
+		fprintf(cg->fptr,
+		        "\tif(data_is_nullary(v_%ld)) goto case_%ld;\n",
+		        var_id,
+		        next_case_index);
+	}
+	if (with_fields > 1) {
+		fprintf(cg->fptr,
+		        "\tif(v_%ld->type != DATA_%s_%s) goto case_%ld;\n",
+		        var_id,
+		        data_type_name,
+		        constructor_name,
+		        next_case_index);
+	}
+}
+
+/* Ints, Chars and data, which can be held evaluated without a thunk */
+static int is_unboxed_type(struct code_generator *cg, struct type *type) {
+	return strcmp(type->name, "Int") == 0 || strcmp(type->name, "Char") == 0 ||
+	       strcmp(type->name, "[]") == 0 ||
+	       map_get_str(cg->dec_datas, type->name) != NULL;
+}
+
+/* unboxed types which are held in a register, not pointing to memory */
+static int is_immediate_type(struct code_generator *cg, struct type *type) {
+	return strcmp(type->name, "Int") == 0 || strcmp(type->name, "Char") == 0 ||
+	       is_enum_data(cg, type->name);
+}
+
+static void code_gen_unboxed_type(struct code_generator *cg,
+                                  struct type *type) {
+	if (strcmp(type->name, "Int") == 0) {
+		fprintf(cg->fptr, "int");
+	} else if (strcmp(type->name, "Char") == 0) {
+		fprintf(cg->fptr, "char");
+	} else {
+		fprintf(
+			cg->fptr, "%s", data_c_type(cg, translate_type_name(type->name)));
+	}
+}
+
+static size_t value_arity(struct value *value) {
+	struct def_value *def_value = list_head(value->def_values);
+	return list_length(def_value->expr_params);
+}
+
+/* arity of a function defined at the top level, 0 for anything that has to be
+ * applied through its pap (variables, values of function type) */
+static size_t known_arity(struct code_generator *cg,
+                          char *name,
+                          struct set *param_vars) {
+	struct value *value;
+	if (param_vars != NULL && set_has_str(param_vars, name)) {
+		return 0;
+	}
+	value = map_get_str(cg->values, name);
+	if (value != NULL) {
+		return value_arity(value);
+	}
+	return (size_t)map_get_str(cg->fn_arities, name);
+}
+
+static void code_gen_static_pap(struct code_generator *cg,
+                                char *name,
+                                size_t arity) {
+	fprintf(cg->fptr, "struct pap _pap_%s = {\n", name);
+	fprintf(cg->fptr, "\t.arity    = %ld,\n", arity);
+	fprintf(cg->fptr, "\t.args_len = 0,\n");
+	fprintf(cg->fptr, "\t.fn       = fn_%s,\n", name);
+	fprintf(cg->fptr, "\t.args     = NULL,\n");
+	fprintf(cg->fptr, "};\n");
+	fprintf(cg->fptr, "struct thunk _val_%s = {\n", name);
+	fprintf(cg->fptr, "\t.region  = &r_global,\n");
+	fprintf(cg->fptr,
+	        "\t.info    = thunk_info_state(&info_Fn, THUNK_EVALUATED),\n");
+	fprintf(cg->fptr, "\t.v.value = &_pap_%s,\n", name);
+	fprintf(cg->fptr, "};\n");
+	fprintf(cg->fptr, "struct thunk *val_%s = &_val_%s;\n", name, name);
+}
+
+/* a top level value is a single updatable thunk, so it is evaluated at most
+ * once and shared by everything that uses it */
+static void code_gen_caf(struct code_generator *cg, struct value *value) {
+	char *name    = value->dec_type->name;
+	rid region_id = (rid)map_get_str(cg->identifier_to_rid, name);
+	fprintf(cg->fptr, "struct closure _closure_%s = {\n", name);
+	fprintf(cg->fptr, "\t.args = NULL,\n");
+	fprintf(cg->fptr, "\t.fn   = fn_%s,\n", name);
+	fprintf(cg->fptr, "};\n");
+	fprintf(cg->fptr, "struct thunk _val_%s = {\n", name);
+	fprintf(cg->fptr, "\t.region    = &r_%ld,\n", region_id);
+	fprintf(cg->fptr,
+	        "\t.info      = thunk_info_state(&info_%s, THUNK_UNEVALUATED),\n",
+	        translate_info_name(value->dec_type->type));
+	fprintf(cg->fptr, "\t.v.closure = &_closure_%s,\n", name);
+	fprintf(cg->fptr, "};\n");
+	fprintf(cg->fptr, "struct thunk *val_%s = &_val_%s;\n", name, name);
+	list_append(cg->cafs, name);
+}
+
 static void add_value_dec(struct code_generator *cg,
                           struct dec_type *dec_type) {
 	struct value *value      = arena_push_struct_zero(cg->arena, struct value);
@@ -76,47 +358,171 @@ static void add_value_def(struct code_generator *cg,
 	list_prepend_all(value->thunks_to_release, thunks_to_release_in_def_value);
 }
 
+/* strict Int, Char and data fields are stored evaluated, without a thunk */
+static int is_unboxed_field(struct code_generator *cg,
+                            struct dec_constructor *dec_constructor,
+                            size_t i) {
+	return dec_constructor != NULL && dec_constructor->strict_params != NULL &&
+	       (size_t)list_get(dec_constructor->strict_params, i) &&
+	       is_unboxed_type(cg, list_get(dec_constructor->type_params, i));
+}
+
+static int is_strict_field(struct dec_constructor *dec_constructor,
+                           size_t i) {
+	return dec_constructor->strict_params != NULL &&
+	       (size_t)list_get(dec_constructor->strict_params, i);
+}
+
+/* whether field i of the constructor only ever holds unique values */
+static int is_owned_field(struct code_generator *cg,
+                          char *constructor_name,
+                          size_t i) {
+	char *owned = map_get_str(cg->owned_fields, constructor_name);
+	return owned != NULL && owned[i];
+}
+
+/* fields are laid out pointers first, then ints and enums, then chars, so
+ * there is no padding between them */
+static int field_alignment_rank(struct code_generator *cg,
+                                struct dec_constructor *dec_constructor,
+                                size_t i) {
+	struct type *type = list_get(dec_constructor->type_params, i);
+	if (!is_unboxed_field(cg, dec_constructor, i)) {
+		return 0;
+	}
+	if (strcmp(type->name, "Char") == 0) {
+		return 2;
+	}
+	return is_immediate_type(cg, type) ? 1 : 0;
+}
+
+static void code_gen_field_type(struct code_generator *cg,
+                                struct dec_constructor *dec_constructor,
+                                size_t i) {
+	if (is_unboxed_field(cg, dec_constructor, i)) {
+		code_gen_unboxed_type(cg, list_get(dec_constructor->type_params, i));
+	} else {
+		fprintf(cg->fptr, "struct thunk *");
+	}
+}
+
 static void
 code_gen_dec_constructor_struct(struct code_generator *cg,
                                 struct dec_constructor *dec_constructor) {
-	size_t param_index;
+	size_t arity = list_length(dec_constructor->type_params);
+	int rank;
+	size_t i;
 
-	if (list_length(dec_constructor->type_params) == 0) {
+	if (arity == 0) {
 		return;
 	}
 
-	param_index = 0;
 	fprintf(cg->fptr, "\t\tstruct {\n");
-	list_for_each(
-		dec_constructor->type_params, struct type *, (void)_value;
-		fprintf(cg->fptr, "\t\t\tstruct thunk *param_%ld;\n", param_index++););
+	for (rank = 0; rank < 3; rank++) {
+		for (i = 0; i < arity; i++) {
+			if (field_alignment_rank(cg, dec_constructor, i) == rank) {
+				fprintf(cg->fptr, "\t\t\t");
+				code_gen_field_type(cg, dec_constructor, i);
+				fprintf(cg->fptr, " param_%ld;\n", i);
+			}
+		}
+	}
 	fprintf(cg->fptr, "\t\t} %s;\n", dec_constructor->name);
 }
 
+/* fn_X_init fills in data wherever it is, a region or a C stack frame. the
+ * constructor's worker takes its unboxed fields evaluated, and forces its
+ * other strict fields */
 static void
-code_gen_dec_constructor_func(struct code_generator *cg,
-                              char *data_name,
-                              struct dec_constructor *dec_constructor) {
+code_gen_dec_constructor_worker(struct code_generator *cg,
+                                char *data_name,
+                                struct dec_constructor *dec_constructor) {
 	size_t arity = list_length(dec_constructor->type_params);
+	size_t i;
 
-	if (arity == 0) {
+	fprintf(cg->fptr,
+	        "struct data_%s *fn_%s_init(struct data_%s *value",
+	        data_name,
+	        dec_constructor->name,
+	        data_name);
+	for (i = 0; i < arity; i++) {
+		fprintf(cg->fptr, ", ");
+		code_gen_field_type(cg, dec_constructor, i);
+		fprintf(cg->fptr, " v_%ld", i);
+	}
+	fprintf(cg->fptr, ") {\n");
+	fprintf(cg->fptr,
+	        "\tvalue->type = DATA_%s_%s;\n",
+	        data_name,
+	        dec_constructor->name);
+	for (i = 0; i < arity; i++) {
+		if (is_strict_field(dec_constructor, i) &&
+		    !is_unboxed_field(cg, dec_constructor, i)) {
+			fprintf(cg->fptr, "\t(void)thunk_eval(v_%ld, void *);\n", i);
+		}
+		fprintf(cg->fptr,
+		        "\tvalue->v.%s.param_%ld = v_%ld;\n",
+		        dec_constructor->name,
+		        i,
+		        i);
+	}
+	fprintf(cg->fptr,
+	        "\treturn %s;\n",
+	        code_gen_tagged(cg, data_name, dec_constructor->name, "value"));
+	fprintf(cg->fptr, "}\n");
+
+	fprintf(cg->fptr,
+	        "struct data_%s *fn_%s_w(",
+	        data_name,
+	        dec_constructor->name);
+	for (i = 0; i < arity; i++) {
+		code_gen_field_type(cg, dec_constructor, i);
+		fprintf(cg->fptr, " v_%ld, ", i);
+	}
+	fprintf(cg->fptr, "struct region *region) {\n");
+	fprintf(cg->fptr, "\tstruct data_%s *value;\n", data_name);
+
+	if (cg->gc_mode == GC_COPYING) {
+		/* everything is in the heap */
 		fprintf(cg->fptr,
-		        "struct data_%s _data_%s_%s = {\n",
+		        "\tvalue = region_push_data(region, struct data_%s, %s);\n",
 		        data_name,
+		        dec_constructor->name);
+	} else {
+		fprintf(cg->fptr, "\tif (region == NULL) {\n");
+		fprintf(cg->fptr,
+		        "\tvalue = calloc(1, sizeof(struct data_%s));\n",
+		        data_name);
+		fprintf(cg->fptr, "\t} else {\n");
+		fprintf(cg->fptr,
+		        "\t\tvalue = region_push_data(region, struct data_%s, %s);\n",
 		        data_name,
 		        dec_constructor->name);
-		fprintf(
-			cg->fptr, "\t.type = DATA_%s_%s,\n", data_name, dec_constructor->name);
-		fprintf(cg->fptr, "};\n");
+		fprintf(cg->fptr, "\t}\n");
+	}
+	fprintf(cg->fptr, "\treturn fn_%s_init(value", dec_constructor->name);
+	for (i = 0; i < arity; i++) {
+		fprintf(cg->fptr, ", v_%ld", i);
+	}
+	fprintf(cg->fptr, ");\n");
+	fprintf(cg->fptr, "}\n");
+}
+
+static void
+code_gen_dec_constructor_func(struct code_generator *cg,
+                              char *data_name,
+                              struct dec_constructor *dec_constructor) {
+	size_t arity = list_length(dec_constructor->type_params);
 
+	if (arity == 0) {
 		fprintf(cg->fptr, "struct thunk _val_%s = {\n", dec_constructor->name);
-		fprintf(cg->fptr, "\t.region    = &r_global,\n");
-		fprintf(cg->fptr, "\t.evaluated = 1,\n");
-		fprintf(cg->fptr, "\t.closure   = NULL,\n");
+		fprintf(cg->fptr, "\t.region  = &r_global,\n");
 		fprintf(cg->fptr,
-		        "\t.value     = &_data_%s_%s,\n",
-		        data_name,
-		        dec_constructor->name);
+		        "\t.info    = thunk_info_state(&info_%s, THUNK_EVALUATED),\n",
+		        data_name);
+		fprintf(cg->fptr,
+		        "\t.v.value = (void *)%s,\n",
+		        code_gen_nullary(cg, data_name, dec_constructor->name));
 		fprintf(cg->fptr, "};\n");
 
 		fprintf(cg->fptr,
@@ -126,54 +532,88 @@ code_gen_dec_constructor_func(struct code_generator *cg,
 	} else {
 		size_t i;
 
-		/* function */
-		fprintf(cg->fptr,
-		        "void *fn_%s(struct thunk **args, struct region *region) {\n",
-		        dec_constructor->name);
-		fprintf(cg->fptr, "\tstruct data_%s *value;\n", data_name);
-
-		fprintf(cg->fptr, "\tif (region == NULL) {\n");
-		fprintf(
-			cg->fptr, "\tvalue = calloc(1, sizeof(struct data_%s));\n", data_name);
-		fprintf(cg->fptr, "\t} else {\n");
-		fprintf(cg->fptr,
-		        "\t\tvalue = region_push_struct(region, struct data_%s);\n",
-		        data_name);
-		fprintf(cg->fptr, "\t}\n");
+		code_gen_dec_constructor_worker(cg, data_name, dec_constructor);
 
+		/* function, evaluating the fields the worker takes unboxed */
 		fprintf(cg->fptr,
-		        "\tvalue->type = DATA_%s_%s;\n",
-		        data_name,
+		        "void *fn_%s(struct thunk **args, struct region *region) {\n",
 		        dec_constructor->name);
+		fprintf(cg->fptr, "\treturn fn_%s_w(", dec_constructor->name);
 		for (i = 0; i < arity; i++) {
-			fprintf(cg->fptr,
-			        "\tvalue->v.%s.param_%ld = args[%ld];\n",
-			        dec_constructor->name,
-			        i,
-			        i);
+			if (is_unboxed_field(cg, dec_constructor, i)) {
+				fprintf(cg->fptr, "thunk_eval(args[%ld], ", i);
+				code_gen_field_type(cg, dec_constructor, i);
+				fprintf(cg->fptr, "), ");
+			} else {
+				fprintf(cg->fptr, "args[%ld], ", i);
+			}
 		}
-		fprintf(cg->fptr, "\treturn value;\n");
+		fprintf(cg->fptr, "region);\n");
 		fprintf(cg->fptr, "}\n");
 
-		/* closure */
-		fprintf(
-			cg->fptr, "struct closure _closure_%s = {\n", dec_constructor->name);
-		fprintf(cg->fptr, "\t.fn_arity = %ld,\n", arity);
-		fprintf(cg->fptr, "\t.args_len = 0,\n");
-		fprintf(cg->fptr, "\t.fn       = fn_%s,\n", dec_constructor->name);
-		fprintf(cg->fptr, "\t.args     = NULL,\n");
-		fprintf(cg->fptr, "};\n");
-		fprintf(cg->fptr,
-		        "struct closure *closure_%s = &_closure_%s;\n",
-		        dec_constructor->name,
-		        dec_constructor->name);
+		code_gen_static_pap(cg, dec_constructor->name, arity);
+		map_put_str(cg->fn_arities, dec_constructor->name, (void *)arity);
 	}
 
 	fprintf(cg->fptr, "\n");
 }
 
+/* where the pointers are in values built by the constructor: its lazy fields,
+ * and its strict ones which aren't immediates, along with their type */
+static void code_gen_layout(struct code_generator *cg,
+                            char *data_name,
+                            struct dec_constructor *dec_constructor) {
+	char *name               = dec_constructor->name;
+	struct list *type_params = dec_constructor->type_params;
+	size_t fields_len        = 0;
+	size_t i;
+
+	if (list_length(type_params) == 0) {
+		return;
+	}
+	for (i = 0; i < list_length(type_params); i++) {
+		struct type *type = list_get(type_params, i);
+		int is_unboxed    = is_unboxed_field(cg, dec_constructor, i);
+		if (is_unboxed && is_immediate_type(cg, type)) {
+			continue;
+		}
+		if (fields_len++ == 0) {
+			fprintf(cg->fptr,
+			        "static const struct field_layout fields_%s[] = {\n",
+			        name);
+		}
+		fprintf(cg->fptr,
+		        "\t{offsetof(struct data_%s, v.%s.param_%ld), ",
+		        data_name,
+		        name,
+		        i);
+		if (is_unboxed) {
+			fprintf(cg->fptr, "&info_%s},\n", translate_type_name(type->name));
+		} else {
+			fprintf(cg->fptr, "NULL},\n");
+		}
+	}
+	if (fields_len > 0) {
+		fprintf(cg->fptr, "};\n");
+	}
+	fprintf(cg->fptr,
+	        "const struct object_layout layout_%s = {\n"
+	        "\t.size       = data_size(struct data_%s, %s),\n"
+	        "\t.fields_len = %ld,\n",
+	        name,
+	        data_name,
+	        name,
+	        fields_len);
+	if (fields_len > 0) {
+		fprintf(cg->fptr, "\t.fields     = fields_%s,\n", name);
+	}
+	fprintf(cg->fptr, "};\n");
+}
+
 static void code_gen_dec_data(struct code_generator *cg,
                               struct dec_data *dec_data) {
+	struct list_iter iter;
+
 	/* type enum */
 	fprintf(cg->fptr, "enum data_%s_type {\n", dec_data->name);
 	list_for_each(
@@ -182,6 +622,18 @@ static void code_gen_dec_data(struct code_generator *cg,
 		fprintf(cg->fptr, "\tDATA_%s_%s,\n", dec_data->name, _value->name));
 	fprintf(cg->fptr, "};\n");
 
+	if (is_enum_data(cg, dec_data->name)) {
+		/* values are the enum itself, so there is nothing to copy */
+		fprintf(cg->fptr,
+		        "const struct thunk_info info_%s = {.kind = VALUE_IMMEDIATE};\n",
+		        dec_data->name);
+		fprintf(cg->fptr, "\n");
+		list_for_each(dec_data->dec_constructors,
+		              struct dec_constructor *,
+		              code_gen_dec_constructor_func(cg, dec_data->name, _value));
+		return;
+	}
+
 	/* type struct */
 	fprintf(cg->fptr, "struct data_%s {\n", dec_data->name);
 	fprintf(cg->fptr, "\tenum data_%s_type type;\n", dec_data->name);
@@ -192,38 +644,30 @@ static void code_gen_dec_data(struct code_generator *cg,
 	fprintf(cg->fptr, "\t} v;\n");
 	fprintf(cg->fptr, "};\n");
 
-	/* copy function */
+	/* layouts, which the runtime copies and collects values by */
+	list_for_each(dec_data->dec_constructors,
+	              struct dec_constructor *,
+	              code_gen_layout(cg, dec_data->name, _value));
 	fprintf(cg->fptr,
-	        "void *value_copy_%s(void *value, struct region *region) {\n",
+	        "static const struct object_layout *const layouts_%s[] = {",
+	        dec_data->name);
+	iter = list_iterate(dec_data->dec_constructors);
+	while (!list_iter_at_end(&iter)) {
+		struct dec_constructor *dec_constructor = list_iter_next(&iter);
+		if (list_length(dec_constructor->type_params) == 0) {
+			fprintf(cg->fptr, "NULL");
+		} else {
+			fprintf(cg->fptr, "&layout_%s", dec_constructor->name);
+		}
+		fprintf(cg->fptr, list_iter_at_end(&iter) ? "};\n" : ", ");
+	}
+	fprintf(cg->fptr,
+	        "const struct thunk_info info_%s = {\n"
+	        "\t.kind         = VALUE_DATA,\n"
+	        "\t.constructors = layouts_%s,\n"
+	        "};\n\n",
+	        dec_data->name,
 	        dec_data->name);
-	fprintf(cg->fptr, "\tstruct data_%s *data = value;\n", dec_data->name);
-	fprintf(
-		cg->fptr,
-		"\tstruct data_%s *copy = region_push_struct(region, struct data_%s);\n",
-		dec_data->name,
-		dec_data->name);
-	fprintf(cg->fptr, "\tcopy->type = data->type;\n");
-	list_for_each(
-		dec_data->dec_constructors, struct dec_constructor *, size_t i = 0;
-		struct dec_constructor *dec_constructor = _value;
-		if (dec_constructor->type_params == NULL ||
-	      list_length(dec_constructor->type_params) == 0) continue;
-		fprintf(cg->fptr,
-	          "\tif (data->type == DATA_%s_%s) {\n",
-	          dec_data->name,
-	          dec_constructor->name);
-		list_for_each(dec_constructor->type_params, struct type *, (void)_value);
-		fprintf(
-			cg->fptr,
-			"\t\tcopy->v.%s.param_%ld = thunk_copy(data->v.%s.param_%ld, region);\n",
-			dec_constructor->name,
-			i,
-			dec_constructor->name,
-			i);
-		fprintf(cg->fptr, "\t}\n"););
-	fprintf(cg->fptr, "\treturn copy;\n");
-	fprintf(cg->fptr, "}\n");
-	fprintf(cg->fptr, "\n");
 
 	/* constructor functions */
 	list_for_each(dec_data->dec_constructors,
@@ -231,6 +675,28 @@ static void code_gen_dec_data(struct code_generator *cg,
 	              code_gen_dec_constructor_func(cg, dec_data->name, _value));
 }
 
+/* data types are known up front, as fields can refer to later ones */
+static void add_dec_data(struct code_generator *cg,
+                         struct dec_data *dec_data) {
+	struct list_iter iter;
+	map_put_str(cg->dec_datas, dec_data->name, dec_data);
+	list_for_each(dec_data->dec_constructors,
+	              struct dec_constructor *,
+	              map_put_str(cg->constructors, _value->name, _value));
+	fprintf(cg->fptr,
+	        "extern const struct thunk_info info_%s;\n",
+	        dec_data->name);
+	iter = list_iterate(dec_data->dec_constructors);
+	while (!list_iter_at_end(&iter)) {
+		struct dec_constructor *dec_constructor = list_iter_next(&iter);
+		if (list_length(dec_constructor->type_params) > 0) {
+			fprintf(cg->fptr,
+			        "extern const struct object_layout layout_%s;\n",
+			        dec_constructor->name);
+		}
+	}
+}
+
 static void code_gen_dec_type(struct code_generator *cg,
                               struct dec_type *dec_type) {
 	rid region_id = (rid)map_get_str(cg->region_var_to_id, dec_type->region_var);
@@ -241,14 +707,17 @@ static void code_gen_dec_type(struct code_generator *cg,
 		region_id = cg->rid_state++;
 		map_put_str(cg->region_var_to_id, dec_type->region_var, (void *)region_id);
 		fprintf(cg->fptr, "struct region r_%ld = {\n", region_id);
-		fprintf(cg->fptr, "\t.arena           = NULL,\n");
 		fprintf(cg->fptr, "\t.reference_count = 0,\n");
+		fprintf(cg->fptr, "\t.is_static       = 1,\n");
 		fprintf(cg->fptr, "};\n");
 	}
 
 	map_put_str(cg->identifier_to_rid, dec_type->name, (void *)region_id);
 
-	fprintf(cg->fptr, "struct closure *closure_%s;\n", dec_type->name);
+	fprintf(cg->fptr,
+	        "void *fn_%s(struct thunk **args, struct region *region);\n",
+	        dec_type->name);
+	fprintf(cg->fptr, "struct thunk _val_%s;\n", dec_type->name);
 	fprintf(cg->fptr, "struct thunk *val_%s;\n", dec_type->name);
 	fprintf(cg->fptr, "\n");
 }
@@ -310,106 +779,402 @@ static void code_gen_stmt(struct code_generator *cg, struct stmt *stmt) {
 }
 
 static void code_gen_prog(struct code_generator *cg, struct prog *prog) {
-	fprintf(cg->fptr, "#include <arena.h>\n");
+	if (cg->gc_mode == GC_COPYING) {
+		fprintf(cg->fptr, "#define RACC_GC_COPYING\n");
+	}
+	if (cg->par_mode != PAR_NONE) {
+		fprintf(cg->fptr, "#define RACC_PARALLEL\n");
+	}
 	fprintf(cg->fptr, "#include <base.h>\n");
 	fprintf(cg->fptr, "#include <stdio.h>\n");
 	fprintf(cg->fptr, "#include <stdlib.h>\n");
 	fprintf(cg->fptr, "\n");
+	list_for_each(prog->stmts,
+	              struct stmt *,
+	              if (_value->type == STMT_DEC_DATA)
+		              add_dec_data(cg, _value->v.dec_data));
+	fprintf(cg->fptr, "\n");
 	list_for_each(prog->stmts, struct stmt *, code_gen_stmt(cg, _value));
 }
 
-static vid vid_next(vid *var_id_state) {
-	vid next = *var_id_state;
-	*var_id_state += 1;
-	return next;
-}
-
-static vid vid_curr(vid *var_id_state) { return *var_id_state - 1; }
+/* ========== STATIC DATA ========== */
 
-/* checks if param (thunk stored in param_vid) matches expr */
-static void code_gen_pattern_check_param(struct code_generator *cg,
-                                         vid param_thunk_vid,
-                                         struct expr *expr,
-                                         vid *vid_state,
-                                         size_t next_case_index,
-                                         struct set *param_vars) {
+/* whether expr is data known at compile time, which is built into the output
+ * as static initializers rather than at runtime */
+static int is_static_expr(struct code_generator *cg,
+                          struct expr *expr,
+                          struct set *param_vars) {
 	switch (expr->expr_type) {
-	case EXPR_IDENTIFIER:
-		if (expr->v.identifier[0] == '_') {
-			break;
+	case EXPR_LIT_INT:
+	case EXPR_LIT_CHAR:
+	case EXPR_LIT_BOOL:
+	case EXPR_LIST_NULL: return 1;
+	case EXPR_IDENTIFIER: {
+		/* constructors and top level values all have a static thunk */
+		char *name = translate_identifier_name(expr->v.identifier);
+		if (isupper(name[0])) {
+			return 1;
 		}
-		if (islower(expr->v.identifier[0])) {
-			/* variable */
-			fprintf(cg->fptr,
-			        "\tstruct thunk *val_%s = v_%ld;\n",
-			        expr->v.identifier,
-			        param_thunk_vid);
-			set_put_str(param_vars, expr->v.identifier);
-		} else {
-			/* data type (no params) */
-			size_t var_id          = vid_next(vid_state);
-			char *data_type_name   = translate_type_name(expr->type->name);
-			char *constructor_name = translate_identifier_name(expr->v.identifier);
-			fprintf(cg->fptr,
-			        "\tstruct data_%s *v_%ld = thunk_eval(v_%ld, struct data_%s*);\n",
-			        data_type_name,
-			        var_id,
-			        param_thunk_vid,
-			        data_type_name);
+		return (param_vars == NULL || !set_has_str(param_vars, name)) &&
+		       map_get_str(cg->values, name) != NULL;
+	}
+	case EXPR_APPLICATION: {
+		char *fn_name   = translate_identifier_name(expr->v.application.fn);
+		size_t args_len = list_length(expr->v.application.expr_args);
+		struct dec_constructor *dec_constructor =
+			map_get_str(cg->constructors, fn_name);
+		size_t i = 0;
+		if (!isupper(fn_name[0]) || known_arity(cg, fn_name, NULL) != args_len) {
+			return 0;
+		}
+		/* unboxed fields need their value, which top level values don't have
+		 * until they are evaluated */
+		list_for_each(expr->v.application.expr_args,
+		              struct expr *,
+		              if (!is_static_expr(cg, _value, param_vars) ||
+		                  (is_unboxed_field(cg, dec_constructor, i++) &&
+		                   _value->expr_type == EXPR_IDENTIFIER &&
+		                   !isupper(_value->v.identifier[0]))) return 0;);
+		return 1;
+	}
+	default: return 0;
+	}
+}
+
+/* static exprs that need their own static thunk emitting */
+static int is_static_root(struct code_generator *cg,
+                          struct expr *expr,
+                          struct set *param_vars) {
+	return expr->expr_type != EXPR_IDENTIFIER &&
+	       expr->expr_type != EXPR_LIST_NULL &&
+	       is_static_expr(cg, expr, param_vars);
+}
+
+static char *static_expr_name(struct code_generator *cg, struct expr *expr) {
+	return map_get(cg->static_exprs, (u8 *)&expr, sizeof(struct expr *));
+}
+
+static char *code_gen_static_expr(struct code_generator *cg,
+                                  struct expr *expr,
+                                  char *thunk_name);
+
+/* name of the static thunk holding a part of a static expr */
+static char *code_gen_static_field(struct code_generator *cg,
+                                   struct expr *expr) {
+	char *name;
+	switch (expr->expr_type) {
+	case EXPR_LIST_NULL: return "_val_Null";
+	case EXPR_IDENTIFIER:
+		name = arena_push_array_zero(
+			cg->arena, strlen(expr->v.identifier) + sizeof("_val_"), char);
+		sprintf(name, "_val_%s", translate_identifier_name(expr->v.identifier));
+		return name;
+	default: return code_gen_static_expr(cg, expr, NULL);
+	}
+}
+
+/* the initializer of an unboxed field holding a part of a static expr */
+static char *code_gen_static_unboxed_field(struct code_generator *cg,
+                                           struct expr *expr) {
+	char *value;
+	switch (expr->expr_type) {
+	case EXPR_LIT_INT:
+	case EXPR_LIT_CHAR:
+		value = arena_push_array_zero(cg->arena, 32, char);
+		sprintf(value,
+		        "%d",
+		        expr->expr_type == EXPR_LIT_INT ? expr->v.lit_int
+		                                        : expr->v.lit_char);
+		return value;
+	case EXPR_LIST_NULL: return code_gen_nullary(cg, "List", "Null");
+	case EXPR_IDENTIFIER:
+		return code_gen_nullary(
+			cg, translate_type_name(expr->type->name), expr->v.identifier);
+	default: {
+		char *thunk_name = code_gen_static_expr(cg, expr, NULL);
+		value            = arena_push_array_zero(
+			cg->arena, strlen(thunk_name) + sizeof("&_data"), char);
+		sprintf(value, "&_data%s", thunk_name);
+		return code_gen_tagged(
+			cg,
+			translate_type_name(expr->type->name),
+			translate_identifier_name(expr->v.application.fn),
+			value);
+	}
+	}
+}
+
+/* emits a static thunk for expr, and its data, named thunk_name or a fresh
+ * name when it is NULL */
+static char *code_gen_static_expr(struct code_generator *cg,
+                                  struct expr *expr,
+                                  char *thunk_name) {
+	char *info_name = translate_info_name(expr->type);
+
+	if (thunk_name == NULL) {
+		thunk_name = arena_push_array_zero(cg->arena, 32, char);
+		sprintf(thunk_name, "_static_%ld", cg->static_state++);
+	}
+
+	if (expr->expr_type == EXPR_APPLICATION) {
+		size_t args_len       = list_length(expr->v.application.expr_args);
+		char **field_names    = calloc(args_len, sizeof(char *));
+		char *data_type_name  = translate_type_name(expr->type->name);
+		char *constructor_name = translate_identifier_name(expr->v.application.fn);
+		struct dec_constructor *dec_constructor =
+			map_get_str(cg->constructors, constructor_name);
+		size_t i;
+
+		/* fields first, so they are declared before the data */
+		i = 0;
+		list_for_each(expr->v.application.expr_args,
+		              struct expr *,
+		              field_names[i] =
+		                is_unboxed_field(cg, dec_constructor, i)
+		                  ? code_gen_static_unboxed_field(cg, _value)
+		                  : code_gen_static_field(cg, _value);
+		              i++);
+
+		fprintf(
+			cg->fptr, "struct data_%s _data%s = {\n", data_type_name, thunk_name);
+		fprintf(cg->fptr,
+		        "\t.type = DATA_%s_%s,\n",
+		        data_type_name,
+		        constructor_name);
+		fprintf(cg->fptr, "\t.v.%s = {\n", constructor_name);
+		for (i = 0; i < args_len; i++) {
 			fprintf(cg->fptr,
-			        "\tif(v_%ld->type != DATA_%s_%s) goto case_%ld;\n",
-			        var_id,
-			        data_type_name,
-			        constructor_name,
-			        next_case_index);
+			        is_unboxed_field(cg, dec_constructor, i)
+			          ? "\t\t.param_%ld = %s,\n"
+			          : "\t\t.param_%ld = &%s,\n",
+			        i,
+			        field_names[i]);
+		}
+		fprintf(cg->fptr, "\t},\n");
+		fprintf(cg->fptr, "};\n");
+		free(field_names);
+	}
+
+	fprintf(cg->fptr, "struct thunk %s = {\n", thunk_name);
+	fprintf(cg->fptr, "\t.region  = &r_global,\n");
+	fprintf(cg->fptr,
+	        "\t.info    = thunk_info_state(&info_%s, THUNK_EVALUATED),\n",
+	        info_name);
+	switch (expr->expr_type) {
+	case EXPR_LIT_INT:
+		fprintf(cg->fptr, "\t.v.value = (void *)%d,\n", expr->v.lit_int);
+		break;
+	case EXPR_LIT_CHAR:
+		fprintf(cg->fptr, "\t.v.value = (void *)%d,\n", expr->v.lit_char);
+		break;
+	case EXPR_LIT_BOOL:
+		fprintf(cg->fptr, "\t.v.value = (void *)%d,\n", expr->v.lit_bool);
+		break;
+	case EXPR_APPLICATION: {
+		char *data_name = arena_push_array_zero(
+			cg->arena, strlen(thunk_name) + sizeof("&_data"), char);
+		sprintf(data_name, "&_data%s", thunk_name);
+		fprintf(cg->fptr,
+		        "\t.v.value = %s,\n",
+		        code_gen_tagged(cg,
+		                        translate_type_name(expr->type->name),
+		                        translate_identifier_name(expr->v.application.fn),
+		                        data_name));
+		break;
+	}
+	default: assert(0); /* not a static root */
+	}
+	fprintf(cg->fptr, "};\n");
+
+	map_put(cg->static_exprs, (u8 *)&expr, sizeof(struct expr *), thunk_name);
+	return thunk_name;
+}
+
+/* emits static data for the largest constant parts of expr */
+static void code_gen_static_subexprs(struct code_generator *cg,
+                                     struct expr *expr,
+                                     struct set *param_vars) {
+	if (is_static_root(cg, expr, param_vars)) {
+		code_gen_static_expr(cg, expr, NULL);
+	} else if (expr->expr_type == EXPR_APPLICATION) {
+		list_for_each(expr->v.application.expr_args,
+		              struct expr *,
+		              code_gen_static_subexprs(cg, _value, param_vars));
+	}
+}
+
+static void collect_pattern_vars(struct expr *pattern, struct set *vars) {
+	switch (pattern->expr_type) {
+	case EXPR_IDENTIFIER:
+		if (islower(pattern->v.identifier[0])) {
+			set_put_str(vars, pattern->v.identifier);
+		}
+		break;
+	case EXPR_APPLICATION:
+		list_for_each(pattern->v.application.expr_args,
+		              struct expr *,
+		              collect_pattern_vars(_value, vars));
+		break;
+	case EXPR_GROUPING: collect_pattern_vars(pattern->v.grouping, vars); break;
+	default: break;
+	}
+}
+
+/* ========== FUNCTIONS ========== */
+
+static vid vid_next(vid *var_id_state) {
+	vid next = *var_id_state;
+	*var_id_state += 1;
+	return next;
+}
+
+static vid vid_curr(vid *var_id_state) { return *var_id_state - 1; }
+
+/* evaluates the param thunk in param_vid, unboxed worker params already are
+ * values */
+static void code_gen_param_eval(struct code_generator *cg,
+                                vid param_vid,
+                                int is_unboxed,
+                                char *c_type) {
+	if (is_unboxed) {
+		fprintf(cg->fptr, "v_%ld", param_vid);
+	} else {
+		fprintf(cg->fptr, "thunk_eval(v_%ld, %s)", param_vid, c_type);
+	}
+}
+
+/* variables matching unboxed fields are bound to their value, like a worker's
+ * unboxed params */
+static void add_field_var(struct code_generator *cg,
+                          struct expr *pattern,
+                          vid field_vid,
+                          struct type *type) {
+	struct worker_var *worker_var;
+	while (pattern->expr_type == EXPR_GROUPING) {
+		pattern = pattern->v.grouping;
+	}
+	if (pattern->expr_type != EXPR_IDENTIFIER ||
+	    !islower(pattern->v.identifier[0])) {
+		return;
+	}
+	worker_var       = arena_push_struct_zero(cg->arena, struct worker_var);
+	worker_var->vid  = field_vid;
+	worker_var->type = type;
+	map_put_str(cg->worker_vars, pattern->v.identifier, worker_var);
+}
+
+/* checks if param (thunk stored in param_vid) matches expr */
+static void code_gen_pattern_check_param(struct code_generator *cg,
+                                         vid param_thunk_vid,
+                                         struct expr *expr,
+                                         vid *vid_state,
+                                         size_t next_case_index,
+                                         struct set *param_vars,
+                                         int is_unboxed,
+                                         int is_unique) {
+	switch (expr->expr_type) {
+	case EXPR_IDENTIFIER:
+		if (expr->v.identifier[0] == '_') {
+			break;
+		}
+		if (islower(expr->v.identifier[0])) {
+			/* variable, unboxed ones are worker vars */
+			if (!is_unboxed) {
+				fprintf(cg->fptr,
+				        "\tstruct thunk *val_%s = v_%ld;\n",
+				        expr->v.identifier,
+				        param_thunk_vid);
+			}
+			set_put_str(param_vars, expr->v.identifier);
+		} else {
+			/* data type (no params) */
+			size_t var_id          = vid_next(vid_state);
+			char *data_type_name   = translate_type_name(expr->type->name);
+			char *constructor_name = translate_identifier_name(expr->v.identifier);
+			char *c_type           = data_c_type(cg, data_type_name);
+			fprintf(cg->fptr, "\t%s v_%ld = ", c_type, var_id);
+			code_gen_param_eval(cg, param_thunk_vid, is_unboxed, c_type);
+			fprintf(cg->fptr, ";\n");
+			code_gen_constructor_check(
+				cg, var_id, data_type_name, constructor_name, 1, next_case_index);
 		}
 		break;
 	case EXPR_APPLICATION: {
 		/* data type (with params) */
-		size_t inner_param_index = 0;
-		size_t var_id            = vid_next(vid_state);
-		char *data_type_name     = translate_type_name(expr->type->name);
+		size_t var_id          = vid_next(vid_state);
+		char *data_type_name   = translate_type_name(expr->type->name);
 		char *constructor_name = translate_identifier_name(expr->v.application.fn);
+		char *c_type           = data_c_type(cg, data_type_name);
+		struct dec_constructor *dec_constructor =
+			map_get_str(cg->constructors, constructor_name);
+		struct list_iter args_iter;
+		size_t i;
 		/* evaluate data structure */
-		fprintf(cg->fptr,
-		        "\tstruct data_%s *v_%ld = thunk_eval(v_%ld, struct data_%s*);\n",
-		        data_type_name,
-		        var_id,
-		        param_thunk_vid,
-		        data_type_name);
+		fprintf(cg->fptr, "\t%s v_%ld = ", c_type, var_id);
+		code_gen_param_eval(cg, param_thunk_vid, is_unboxed, c_type);
+		fprintf(cg->fptr, ";\n");
 		/* check it is the right structure type */
-		fprintf(cg->fptr,
-		        "\tif(v_%ld->type != DATA_%s_%s) goto case_%ld;\n",
-		        var_id,
-		        data_type_name,
-		        constructor_name,
-		        next_case_index);
+		code_gen_constructor_check(
+			cg, var_id, data_type_name, constructor_name, 0, next_case_index);
+		if (is_tagged_data(cg, data_type_name)) {
+			fprintf(cg->fptr,
+			        "\tv_%ld = data_untagged(v_%ld, %ld);\n",
+			        var_id,
+			        var_id,
+			        constructor_tag(cg, data_type_name, constructor_name));
+		}
+		if (is_unique && cg->reuse_cells != NULL) {
+			struct reuse_cell *reuse_cell =
+				arena_push_struct_zero(cg->arena, struct reuse_cell);
+			reuse_cell->constructor_name = constructor_name;
+			reuse_cell->vid              = var_id;
+			list_append(cg->reuse_cells, reuse_cell);
+		}
 		/* recurse into its parameters */
-		list_for_each(expr->v.application.expr_args,
-		              struct expr *,
-		              size_t inner_param_thunk_vid = vid_next(vid_state);
-		              /* extract parameter into its own variable */
-		              fprintf(cg->fptr,
-		                      "\tstruct thunk *v_%ld = v_%ld->v.%s.param_%ld;\n",
-		                      inner_param_thunk_vid,
-		                      var_id,
-		                      constructor_name,
-		                      inner_param_index);
-		              code_gen_pattern_check_param(cg,
-		                                           inner_param_thunk_vid,
-		                                           _value,
-		                                           vid_state,
-		                                           next_case_index,
-		                                           param_vars);
-		              inner_param_index++;);
+		args_iter = list_iterate(expr->v.application.expr_args);
+		for (i = 0; !list_iter_at_end(&args_iter); i++) {
+			struct expr *arg = list_iter_next(&args_iter);
+			vid field_vid    = vid_next(vid_state);
+			int is_unboxed   = is_unboxed_field(cg, dec_constructor, i);
+			if (is_unboxed) {
+				/* already evaluated, so used as it is */
+				fprintf(cg->fptr, "\t");
+				code_gen_field_type(cg, dec_constructor, i);
+				fprintf(cg->fptr,
+				        " v_%ld = v_%ld->v.%s.param_%ld;\n",
+				        field_vid,
+				        var_id,
+				        constructor_name,
+				        i);
+				add_field_var(
+					cg, arg, field_vid, list_get(dec_constructor->type_params, i));
+			} else {
+				/* extract parameter into its own variable */
+				fprintf(cg->fptr,
+				        "\tstruct thunk *v_%ld = "
+				        "thunk_follow(&v_%ld->v.%s.param_%ld);\n",
+				        field_vid,
+				        var_id,
+				        constructor_name,
+				        i);
+			}
+			code_gen_pattern_check_param(
+				cg,
+				field_vid,
+				arg,
+				vid_state,
+				next_case_index,
+				param_vars,
+				is_unboxed,
+				is_unique && is_owned_field(cg, constructor_name, i));
+		}
 		break;
 	}
 	case EXPR_LIT_INT: {
 		size_t var_id = vid_next(vid_state);
-		fprintf(cg->fptr,
-		        "\tint v_%ld = thunk_eval(v_%ld, int);\n",
-		        var_id,
-		        param_thunk_vid);
+		fprintf(cg->fptr, "\tint v_%ld = ", var_id);
+		code_gen_param_eval(cg, param_thunk_vid, is_unboxed, "int");
+		fprintf(cg->fptr, ";\n");
 		fprintf(cg->fptr,
 		        "\tif (v_%ld != %d) goto case_%ld;\n",
 		        var_id,
@@ -434,10 +1199,9 @@ static void code_gen_pattern_check_param(struct code_generator *cg,
 	case EXPR_LIT_STRING: break; /* TODO */
 	case EXPR_LIT_CHAR: {
 		size_t var_id = vid_next(vid_state);
-		fprintf(cg->fptr,
-		        "\tchar v_%ld = thunk_eval(v_%ld, char);\n",
-		        var_id,
-		        param_thunk_vid);
+		fprintf(cg->fptr, "\tchar v_%ld = ", var_id);
+		code_gen_param_eval(cg, param_thunk_vid, is_unboxed, "char");
+		fprintf(cg->fptr, ";\n");
 		fprintf(cg->fptr,
 		        "\tif (v_%ld != %c) goto case_%ld;\n",
 		        var_id,
@@ -466,120 +1230,255 @@ static void code_gen_pattern_check_param(struct code_generator *cg,
 		                             expr->v.grouping,
 		                             vid_state,
 		                             next_case_index,
-		                             param_vars);
+		                             param_vars,
+		                             is_unboxed,
+		                             is_unique);
 		break;
 	case EXPR_LIST_NULL: {
 		/* data type (no params) */
 		size_t var_id = vid_next(vid_state);
-		fprintf(
-			cg->fptr,
-			"\tstruct data_List *v_%ld = thunk_eval(v_%ld, struct data_List*);\n",
-			var_id,
-			param_thunk_vid);
-		fprintf(cg->fptr,
-		        "\tif(v_%ld->type != DATA_List_Null) goto case_%ld;\n",
-		        var_id,
-		        next_case_index);
+		fprintf(cg->fptr, "\tstruct data_List* v_%ld = ", var_id);
+		code_gen_param_eval(
+			cg, param_thunk_vid, is_unboxed, "struct data_List*");
+		fprintf(cg->fptr, ";\n");
+		code_gen_constructor_check(
+			cg, var_id, "List", "Null", 1, next_case_index);
 		break;
 	}
 	case EXPR_LET_IN: assert(0); /* no let..in exprs in parameter patterns */
 	}
 }
 
+/* unboxed_params says which params a worker takes unboxed, and unique_params
+ * which are never shared, NULL if none */
 static void code_gen_pattern_check_case(struct code_generator *cg,
                                         struct list *expr_params,
                                         size_t *vid_state,
                                         size_t next_case_index,
-                                        struct set *param_vars) {
+                                        struct set *param_vars,
+                                        char *unboxed_params,
+                                        char *unique_params) {
 	/* the first few vids are each function param thunk */
 	size_t param_thunk_vid = 1;
 	list_for_each(
-		expr_params,
-		struct expr *,
-		code_gen_pattern_check_param(
-			cg, param_thunk_vid, _value, vid_state, next_case_index, param_vars);
+		expr_params, struct expr *,
+		int is_unboxed =
+			unboxed_params != NULL && unboxed_params[param_thunk_vid - 1];
+		int is_unique =
+			unique_params != NULL && unique_params[param_thunk_vid - 1];
+		code_gen_pattern_check_param(cg,
+		                             param_thunk_vid,
+		                             _value,
+		                             vid_state,
+		                             next_case_index,
+		                             param_vars,
+		                             is_unboxed,
+		                             is_unique);
 		param_thunk_vid++;);
 }
 
-static struct type *get_return_type(struct type *type) {
-	while (strcmp(type->name, "->") == 0) {
-		type = list_last(type->type_args);
+static void code_gen_identifier(struct code_generator *cg,
+                                char *name,
+                                vid *vid_state) {
+	struct worker_var *worker_var =
+		cg->worker_vars == NULL ? NULL : map_get_str(cg->worker_vars, name);
+	assert(name[0] != '_');
+	if (worker_var != NULL && cg->is_frame_local) {
+		/* unboxed, lazy uses need it boxed again */
+		fprintf(cg->fptr,
+		        "\tstruct thunk t_%ld = {\n"
+		        "\t\t.region  = region,\n"
+		        "\t\t.info    = thunk_info_state(&info_%s, THUNK_EVALUATED),\n"
+		        "\t\t.v.value = (void *)v_%ld,\n"
+		        "\t};\n",
+		        vid_next(vid_state),
+		        translate_info_name(worker_var->type),
+		        worker_var->vid);
+		fprintf(cg->fptr,
+		        "\tstruct thunk *v_%ld = &t_%ld;\n",
+		        vid_curr(vid_state),
+		        vid_curr(vid_state));
+		return;
 	}
-	return type;
+	if (worker_var != NULL) {
+		cg->is_allocating = 1;
+		fprintf(cg->fptr,
+		        "\tstruct thunk *v_%ld = thunk_lit((void *)v_%ld, region, "
+		        "&info_%s);\n",
+		        vid_next(vid_state),
+		        worker_var->vid,
+		        translate_info_name(worker_var->type));
+		return;
+	}
+	/* values, functions and constructors all have a static thunk */
+	fprintf(
+		cg->fptr, "\tstruct thunk *v_%ld = val_%s;\n", vid_next(vid_state), name);
 }
 
 static void code_gen_expr(struct code_generator *cg,
+                          struct expr *expr,
+                          vid *vid_state,
+                          struct set *param_vars);
+
+/* generates each argument of an application, returning their vids */
+static vid *code_gen_args(struct code_generator *cg,
                           struct expr *expr,
                           vid *vid_state,
                           struct set *param_vars) {
-	switch (expr->expr_type) {
-	case EXPR_IDENTIFIER: {
-		char *name = translate_identifier_name(expr->v.identifier);
-		assert(name[0] != '_');
-		if (islower(name[0])) {
-			/* is variable */
-			if (param_vars == NULL || !set_has_str(param_vars, name)) {
-				rid region_id = (rid)map_get_str(cg->identifier_to_rid, name);
-				fprintf(cg->fptr, "\tif (val_%s == NULL) {\n", name);
-				fprintf(cg->fptr,
-				        "\t\tif (r_%ld.arena == NULL) r_%ld.arena = arena_alloc();\n",
-				        region_id,
-				        region_id);
-				fprintf(
-					cg->fptr,
-					"\t\tval_%s = thunk_closure(closure_%s, &r_%ld, value_copy_%s);\n",
-					name,
-					name,
-					region_id,
-					translate_type_name(get_return_type(expr->type)->name));
-				fprintf(cg->fptr, "\t}\n");
-			}
-		} else {
-			/* is data_structure */
-		}
-		fprintf(
-			cg->fptr, "\tstruct thunk *v_%ld = val_%s;\n", vid_next(vid_state), name);
-		break;
-	}
-	case EXPR_APPLICATION: {
-		size_t args_left  = list_length(expr->v.application.expr_args);
-		vid *arg_indicies = calloc(args_left, sizeof(vid));
-		char *fn_name     = translate_identifier_name(expr->v.application.fn);
-		size_t i;
+	size_t args_len = list_length(expr->v.application.expr_args);
+	vid *arg_vids   = calloc(args_len, sizeof(vid));
+	size_t i;
+
+	i = 0;
+	list_for_each(expr->v.application.expr_args,
+	              struct expr *,
+	              code_gen_expr(cg, _value, vid_state, param_vars);
+	              arg_vids[i] = vid_curr(vid_state);
+	              i++);
+	return arg_vids;
+}
 
-		i = 0;
-		list_for_each(expr->v.application.expr_args,
-		              struct expr *,
-		              code_gen_expr(cg, _value, vid_state, param_vars);
-		              arg_indicies[i] = vid_curr(vid_state);
-		              i++);
+/* the thunk for a known saturated call, with its closure and args, in the C
+ * stack frame rather than the region */
+static void code_gen_frame_call(struct code_generator *cg,
+                                char *fn_name,
+                                char *info_name,
+                                size_t arity,
+                                vid *arg_vids,
+                                vid *vid_state) {
+	vid thunk_vid = vid_next(vid_state);
+	size_t i;
+
+	fprintf(cg->fptr, "\tstruct thunk *a_%ld[] = {", thunk_vid);
+	for (i = 0; i < arity; i++) {
+		fprintf(cg->fptr, i == 0 ? "v_%ld" : ", v_%ld", arg_vids[i]);
+	}
+	fprintf(cg->fptr, "};\n");
+	fprintf(cg->fptr,
+	        "\tstruct closure c_%ld = {.args = a_%ld, .fn = fn_%s};\n",
+	        thunk_vid,
+	        thunk_vid,
+	        fn_name);
+	fprintf(cg->fptr,
+	        "\tstruct thunk t_%ld = {\n"
+	        "\t\t.region    = region,\n"
+	        "\t\t.info      = thunk_info_state(&info_%s, THUNK_UNEVALUATED),\n"
+	        "\t\t.v.closure = &c_%ld,\n"
+	        "\t};\n",
+	        thunk_vid,
+	        info_name,
+	        thunk_vid);
+	fprintf(
+		cg->fptr, "\tstruct thunk *v_%ld = &t_%ld;\n", thunk_vid, thunk_vid);
+	/* forcing it still runs the call in the region */
+	cg->is_allocating = 1;
+}
 
-		fprintf(cg->fptr, "\tstruct thunk *v_%ld = ", vid_next(vid_state));
+static void code_gen_application(struct code_generator *cg,
+                                 struct expr *expr,
+                                 vid *arg_vids,
+                                 vid *vid_state,
+                                 struct set *param_vars) {
+	size_t args_len = list_length(expr->v.application.expr_args);
+	char *fn_name   = translate_identifier_name(expr->v.application.fn);
+	size_t arity    = known_arity(cg, fn_name, param_vars);
+	size_t args_used;
+	vid fn_thunk_vid;
+	size_t i;
 
-		for (i = 0; i < args_left; i++) {
-			fprintf(cg->fptr, "thunk_apply(");
+	if (arity == 0) {
+		/* unknown function, apply to its pap */
+		code_gen_identifier(cg, fn_name, vid_state);
+		fn_thunk_vid = vid_curr(vid_state);
+		args_used    = 0;
+	} else if (args_len < arity) {
+		/* known function, undersaturated */
+		fprintf(cg->fptr,
+		        "\tstruct thunk *v_%ld = thunk_pap(fn_%s, %ld, region, %ld",
+		        vid_next(vid_state),
+		        fn_name,
+		        arity,
+		        args_len);
+		for (i = 0; i < args_len; i++) {
+			fprintf(cg->fptr, ", v_%ld", arg_vids[i]);
 		}
-
+		fprintf(cg->fptr, ");\n");
+		return;
+	} else if (cg->is_frame_local) {
+		code_gen_frame_call(cg,
+		                    fn_name,
+		                    args_len == arity ? translate_info_name(expr->type)
+		                                      : "Fn",
+		                    arity,
+		                    arg_vids,
+		                    vid_state);
+		fn_thunk_vid = vid_curr(vid_state);
+		args_used    = arity;
+	} else {
+		/* known function, saturated: call it directly */
 		fprintf(cg->fptr,
-		        "thunk_closure(closure_%s, region, value_copy_%s), ",
+		        "\tstruct thunk *v_%ld = thunk_call(fn_%s, region, &info_%s, %ld",
+		        vid_next(vid_state),
 		        fn_name,
-		        translate_type_name(expr->type->name));
+		        args_len == arity ? translate_info_name(expr->type) : "Fn",
+		        arity);
+		for (i = 0; i < arity; i++) {
+			fprintf(cg->fptr, ", v_%ld", arg_vids[i]);
+		}
+		fprintf(cg->fptr, ");\n");
+		fn_thunk_vid = vid_curr(vid_state);
+		args_used    = arity;
+	}
 
-		for (i = 0; i < args_left; i++) {
-			fprintf(cg->fptr, "v_%ld)", arg_indicies[i]);
-			if (i < args_left - 1) {
-				fprintf(cg->fptr, ", ");
-			}
+	if (args_used < args_len) {
+		/* oversaturated or unknown, the rest goes through apply_N */
+		fprintf(cg->fptr,
+		        "\tstruct thunk *v_%ld = thunk_apply(v_%ld, region, &info_%s, "
+		        "%ld",
+		        vid_next(vid_state),
+		        fn_thunk_vid,
+		        translate_info_name(expr->type),
+		        args_len - args_used);
+		for (i = args_used; i < args_len; i++) {
+			fprintf(cg->fptr, ", v_%ld", arg_vids[i]);
 		}
+		fprintf(cg->fptr, ");\n");
+	}
+}
 
-		free(arg_indicies);
-		fprintf(cg->fptr, ";\n");
+static void code_gen_expr(struct code_generator *cg,
+                          struct expr *expr,
+                          vid *vid_state,
+                          struct set *param_vars) {
+	char *static_name = static_expr_name(cg, expr);
+	if (static_name != NULL) {
+		fprintf(cg->fptr,
+		        "\tstruct thunk *v_%ld = &%s;\n",
+		        vid_next(vid_state),
+		        static_name);
+		return;
+	}
+
+	if (expr->expr_type != EXPR_IDENTIFIER &&
+	    expr->expr_type != EXPR_LIST_NULL) {
+		cg->is_allocating = 1;
+	}
+
+	switch (expr->expr_type) {
+	case EXPR_IDENTIFIER:
+		code_gen_identifier(
+			cg, translate_identifier_name(expr->v.identifier), vid_state);
+		break;
+	case EXPR_APPLICATION: {
+		vid *arg_vids = code_gen_args(cg, expr, vid_state, param_vars);
+		code_gen_application(cg, expr, arg_vids, vid_state, param_vars);
+		free(arg_vids);
 		break;
 	}
 	case EXPR_LIT_INT: {
 		fprintf(
 			cg->fptr,
-			"\tstruct thunk *v_%ld = thunk_lit((void*)%d, region, value_copy_Int);\n",
+			"\tstruct thunk *v_%ld = thunk_lit((void*)%d, region, &info_Int);\n",
 			vid_next(vid_state),
 			expr->v.lit_int);
 		break;
@@ -613,48 +1512,1443 @@ static void code_gen_expr(struct code_generator *cg,
 	}
 }
 
-static void code_gen_value(struct code_generator *cg, struct value *value) {
-	char *name   = value->dec_type->name;
-	size_t arity = list_length(
-		((struct def_value *)list_head(value->def_values))->expr_params);
+/* let bound values are released on return, and a letregion's region freed, so
+ * the result must be evaluated first rather than left for the trampoline */
+static int is_result_left_lazy(struct value *value) {
+	return list_length(value->thunks_to_release) == 0 &&
+	       !value->dec_type->letregion;
+}
 
-	vid _vid_state = 1;
-	vid *vid_state = &_vid_state;
+/* generates the result of one case of a function. saturated calls to known
+ * functions in tail position don't build a thunk: calls back to the function
+ * itself rebind the arguments and loop, others go through the trampoline */
+static void code_gen_tail_expr(struct code_generator *cg,
+                               struct value *value,
+                               struct expr *expr,
+                               vid *vid_state,
+                               struct set *param_vars) {
+	if (expr->expr_type == EXPR_APPLICATION &&
+	    static_expr_name(cg, expr) == NULL) {
+		char *fn_name   = translate_identifier_name(expr->v.application.fn);
+		size_t arity    = known_arity(cg, fn_name, param_vars);
+		size_t args_len = list_length(expr->v.application.expr_args);
+		int is_self     = strcmp(fn_name, value->dec_type->name) == 0;
+
+		if (arity > 0 && arity == args_len &&
+		    (is_self || is_result_left_lazy(value))) {
+			vid *arg_vids = code_gen_args(cg, expr, vid_state, param_vars);
+			size_t i;
+			if (is_self) {
+				/* the first vids are the function param thunks */
+				for (i = 0; i < arity; i++) {
+					fprintf(cg->fptr, "\tv_%ld = v_%ld;\n", i + 1, arg_vids[i]);
+				}
+				fprintf(cg->fptr, "\tgoto case_0;\n");
+			} else {
+				fprintf(cg->fptr,
+				        "\treturn tail_call(fn_%s, region, %ld",
+				        fn_name,
+				        arity);
+				for (i = 0; i < arity; i++) {
+					fprintf(cg->fptr, ", v_%ld", arg_vids[i]);
+				}
+				fprintf(cg->fptr, ");\n");
+			}
+			free(arg_vids);
+			return;
+		}
+	}
 
-	fprintf(cg->fptr,
-	        "void* fn_%s(struct thunk **args, struct region *region) {\n",
-	        name);
-	fprintf(cg->fptr, "\tvoid* ret_thunk;\n");
+	/* an existing thunk, the caller's thunk can become an indirection to it */
+	if ((expr->expr_type == EXPR_IDENTIFIER ||
+	     static_expr_name(cg, expr) != NULL) &&
+	    is_result_left_lazy(value)) {
+		code_gen_expr(cg, expr, vid_state, param_vars);
+		fprintf(cg->fptr, "\treturn tail_eval(v_%ld);\n", vid_curr(vid_state));
+		return;
+	}
 
-	if (arity == 0) {
-		struct def_value *value_def_value = list_head(value->def_values);
-		code_gen_expr(cg, value_def_value->value, vid_state, NULL);
-		fprintf(cg->fptr, "\tret_thunk = v_%ld;\n", vid_curr(vid_state));
-		fprintf(cg->fptr, "\tgoto ret;\n");
-	} else {
-		size_t i;
-		size_t next_case_index = 0;
+	code_gen_expr(cg, expr, vid_state, param_vars);
+	fprintf(cg->fptr, "\tret_thunk = v_%ld;\n", vid_curr(vid_state));
+	fprintf(cg->fptr, "\tgoto ret;\n");
+}
 
-		/* setup variables for each arg */
-		/* first v_0 .. v_n variables are the arguments */
-		for (i = 0; i < arity; i++) {
-			fprintf(cg->fptr,
-			        "\tstruct thunk *v_%ld = args[%ld];\n",
-			        vid_next(vid_state),
+/* ========== WORKERS ========== */
+
+/* with optimisations, functions with an unboxed result type are split in two.
+ * the worker fn_X_w takes the params every call forces evaluated, Ints, Chars
+ * and data unboxed, and returns its result unboxed. fn_X is left as a wrapper
+ * for paps and thunks. where a worker needs the result of a known call, it
+ * calls the worker directly rather than building a thunk */
+
+static struct type *function_type_at(struct type *type, size_t i) {
+	for (; i > 0; i--) {
+		type = list_last(type->type_args);
+	}
+	return type;
+}
+
+static struct type *function_param_type(struct type *type, size_t i) {
+	return list_head(function_type_at(type, i)->type_args);
+}
+
+static int is_arithmetic(char *fn_name) {
+	return strcmp(fn_name, "+") == 0 || strcmp(fn_name, "-") == 0 ||
+	       strcmp(fn_name, "*") == 0 || strcmp(fn_name, "/") == 0;
+}
+
+/* whether a call of fn_name with args_len args always forces arg i */
+static int is_strict_arg(struct code_generator *cg,
+                         char *fn_name,
+                         size_t args_len,
+                         size_t i) {
+	struct value *value;
+	if (is_arithmetic(fn_name)) {
+		return args_len >= 2 && i < 2;
+	}
+	value = map_get_str(cg->values, fn_name);
+	return value != NULL && value->strict_params != NULL &&
+	       args_len >= value_arity(value) && i < value_arity(value) &&
+	       value->strict_params[i];
+}
+
+/* whether evaluating expr always forces the variable var */
+static int is_strict_in(struct code_generator *cg,
+                        struct expr *expr,
+                        char *var,
+                        struct set *pattern_vars) {
+	switch (expr->expr_type) {
+	case EXPR_IDENTIFIER: return strcmp(expr->v.identifier, var) == 0;
+	case EXPR_GROUPING:
+		return is_strict_in(cg, expr->v.grouping, var, pattern_vars);
+	case EXPR_APPLICATION: {
+		char *fn_name   = expr->v.application.fn;
+		size_t args_len = list_length(expr->v.application.expr_args);
+		size_t i        = 0;
+		if (set_has_str(pattern_vars, fn_name)) {
+			return strcmp(fn_name, var) == 0;
+		}
+		list_for_each(expr->v.application.expr_args,
+		              struct expr *,
+		              if (is_strict_arg(cg, fn_name, args_len, i++) &&
+		                  is_strict_in(cg, _value, var, pattern_vars)) return 1;);
+		return 0;
+	}
+	default: return 0;
+	}
+}
+
+/* updates the params forced by the clauses after def_value to those forced
+ * from def_value on. a clause forces its first refutable pattern before it can
+ * fail, then either all of its patterns and whatever its body forces, or
+ * whatever the clauses after it force */
+static void strict_params_of_clause(struct code_generator *cg,
+                                    struct def_value *def_value,
+                                    size_t arity,
+                                    char *strict) {
+	char *forced             = calloc(arity, sizeof(char));
+	struct set *pattern_vars = set_new();
+	size_t first_refutable   = arity;
+	size_t i;
+
+	list_for_each(def_value->expr_params,
+	              struct expr *,
+	              collect_pattern_vars(_value, pattern_vars));
+	for (i = 0; i < arity; i++) {
+		struct expr *pattern = list_get(def_value->expr_params, i);
+		while (pattern->expr_type == EXPR_GROUPING) {
+			pattern = pattern->v.grouping;
+		}
+		if (pattern->expr_type == EXPR_IDENTIFIER &&
+		    !isupper(pattern->v.identifier[0])) {
+			forced[i] =
+				pattern->v.identifier[0] != '_' &&
+				is_strict_in(cg, def_value->value, pattern->v.identifier, pattern_vars);
+		} else {
+			forced[i] = 1;
+			if (first_refutable == arity) {
+				first_refutable = i;
+			}
+		}
+	}
+	for (i = 0; i < arity; i++) {
+		if (first_refutable == arity) {
+			strict[i] = forced[i]; /* always matches */
+		} else {
+			strict[i] = i == first_refutable || (strict[i] && forced[i]);
+		}
+	}
+	set_free(pattern_vars);
+	free(forced);
+}
+
+/* the params a function always forces, given what the functions it calls
+ * force. when no clause matches it is an error, which forces everything */
+static void strict_params_of(struct code_generator *cg,
+                             struct value *value,
+                             char *strict) {
+	size_t arity = value_arity(value);
+	memset(strict, 1, arity);
+	list_for_each_reverse(value->def_values,
+	                      struct def_value *,
+	                      strict_params_of_clause(cg, _value, arity, strict));
+}
+
+static void strict_params_init(struct code_generator *cg,
+                               struct value *value) {
+	size_t arity = value_arity(value);
+	if (arity > 0) {
+		value->strict_params = arena_push_array_zero(cg->arena, arity, char);
+		memset(value->strict_params, 1, arity);
+	}
+}
+
+/* only ever clears strict params, so the analysis finishes */
+static int strict_params_update(struct code_generator *cg,
+                                struct value *value) {
+	size_t arity  = value_arity(value);
+	char *strict  = calloc(arity, sizeof(char));
+	int is_change = 0;
+	size_t i;
+
+	strict_params_of(cg, value, strict);
+	for (i = 0; i < arity; i++) {
+		if (value->strict_params[i] && !strict[i]) {
+			value->strict_params[i] = 0;
+			is_change               = 1;
+		}
+	}
+	free(strict);
+	return is_change;
+}
+
+static void worker_init(struct code_generator *cg, struct value *value) {
+	size_t arity = value_arity(value);
+	/* let bound values are released on return, which workers don't do */
+	value->has_worker =
+		arity > 0 && list_length(value->thunks_to_release) == 0 &&
+		is_unboxed_type(cg, function_type_at(value->dec_type->type, arity));
+}
+
+/* starts from every param being strict, which recursive calls rely on, then
+ * clears those some call might not force until nothing changes */
+static void worker_analyse(struct code_generator *cg) {
+	int is_change = 1;
+	map_for_each(cg->values, struct value *, strict_params_init(cg, _value));
+	while (is_change) {
+		is_change = 0;
+		map_for_each(cg->values,
+		             struct value *,
+		             if (_value->strict_params != NULL &&
+		                 strict_params_update(cg, _value)) is_change = 1;);
+	}
+	map_for_each(cg->values, struct value *, worker_init(cg, _value));
+}
+
+static size_t count_uses(struct expr *expr, char *var) {
+	size_t uses = 0;
+	switch (expr->expr_type) {
+	case EXPR_IDENTIFIER: return strcmp(expr->v.identifier, var) == 0;
+	case EXPR_GROUPING: return count_uses(expr->v.grouping, var);
+	case EXPR_APPLICATION:
+		uses = strcmp(expr->v.application.fn, var) == 0;
+		list_for_each(expr->v.application.expr_args,
+		              struct expr *,
+		              uses += count_uses(_value, var));
+		return uses;
+	default: return 0;
+	}
+}
+
+/* adds the variables pattern binds which body uses at most once to
+ * unique_vars, if the value they match is unique */
+static void add_unique_vars(struct code_generator *cg,
+                            struct expr *pattern,
+                            int is_unique,
+                            struct expr *body,
+                            struct set *unique_vars) {
+	switch (pattern->expr_type) {
+	case EXPR_IDENTIFIER:
+		if (is_unique && islower(pattern->v.identifier[0]) &&
+		    count_uses(body, pattern->v.identifier) <= 1) {
+			set_put_str(unique_vars, pattern->v.identifier);
+		}
+		break;
+	case EXPR_APPLICATION: {
+		char *constructor_name =
+			translate_identifier_name(pattern->v.application.fn);
+		size_t i = 0;
+		list_for_each(
+			pattern->v.application.expr_args,
+			struct expr *,
+			add_unique_vars(cg,
+			                _value,
+			                is_unique && is_owned_field(cg, constructor_name, i++),
+			                body,
+			                unique_vars));
+		break;
+	}
+	case EXPR_GROUPING:
+		add_unique_vars(cg, pattern->v.grouping, is_unique, body, unique_vars);
+		break;
+	default: break;
+	}
+}
+
+/* whether nothing else refers to expr's value: an immediate, data built at
+ * runtime, the result of a call whose results are unique, or a unique
+ * variable. static data is shared by every use */
+static int is_unique_expr(struct code_generator *cg,
+                          struct expr *expr,
+                          struct set *unique_vars,
+                          struct set *pattern_vars) {
+	if (expr->type != NULL && is_immediate_type(cg, expr->type)) {
+		return 1;
+	}
+	switch (expr->expr_type) {
+	case EXPR_LIT_INT:
+	case EXPR_LIT_CHAR:
+	case EXPR_LIT_BOOL:
+	case EXPR_LIST_NULL: return 1;
+	case EXPR_GROUPING:
+		return is_unique_expr(cg, expr->v.grouping, unique_vars, pattern_vars);
+	case EXPR_IDENTIFIER: {
+		struct dec_constructor *dec_constructor =
+			map_get_str(cg->constructors, expr->v.identifier);
+		if (dec_constructor != NULL &&
+		    list_length(dec_constructor->type_params) == 0) {
+			return 1; /* nullary, an immediate */
+		}
+		return set_has_str(unique_vars, expr->v.identifier);
+	}
+	case EXPR_APPLICATION: {
+		char *fn_name   = translate_identifier_name(expr->v.application.fn);
+		size_t args_len = list_length(expr->v.application.expr_args);
+		struct value *callee;
+		if (set_has_str(pattern_vars, expr->v.application.fn) ||
+		    is_static_expr(cg, expr, pattern_vars)) {
+			return 0;
+		}
+		if (isupper(fn_name[0])) {
+			return args_len == known_arity(cg, fn_name, NULL);
+		}
+		callee = map_get_str(cg->values, fn_name);
+		return callee != NULL && callee->is_result_unique &&
+		       args_len == value_arity(callee);
+	}
+	default: return 0;
+	}
+}
+
+/* the unique params of a function, or owned fields of a constructor */
+static char *unique_flags(struct code_generator *cg, char *name) {
+	struct value *value = map_get_str(cg->values, name);
+	if (value != NULL) {
+		return value->unique_params;
+	}
+	return map_get_str(cg->owned_fields, name);
+}
+
+/* clears the unique params or owned fields of name, used other than by a
+ * saturated call, so passed whatever its callers pass */
+static int unique_flags_clear(struct code_generator *cg,
+                              char *name,
+                              struct set *pattern_vars) {
+	char *unique;
+	size_t arity;
+	size_t i;
+	int is_change = 0;
+	if (set_has_str(pattern_vars, name)) {
+		return 0;
+	}
+	name   = translate_identifier_name(name);
+	unique = unique_flags(cg, name);
+	arity  = known_arity(cg, name, NULL);
+	for (i = 0; unique != NULL && i < arity; i++) {
+		is_change |= unique[i];
+		unique[i] = 0;
+	}
+	return is_change;
+}
+
+/* clears the unique params and owned fields expr passes something shared */
+static int reuse_update_expr(struct code_generator *cg,
+                             struct expr *expr,
+                             struct set *unique_vars,
+                             struct set *pattern_vars) {
+	switch (expr->expr_type) {
+	case EXPR_GROUPING:
+		return reuse_update_expr(
+			cg, expr->v.grouping, unique_vars, pattern_vars);
+	case EXPR_IDENTIFIER:
+		return unique_flags_clear(cg, expr->v.identifier, pattern_vars);
+	case EXPR_APPLICATION: {
+		char *fn_name   = expr->v.application.fn;
+		size_t args_len = list_length(expr->v.application.expr_args);
+		size_t arity =
+			known_arity(cg, translate_identifier_name(fn_name), pattern_vars);
+		char *unique  = NULL;
+		int is_change = 0;
+		size_t i      = 0;
+		if (arity == 0 || args_len < arity) {
+			is_change = unique_flags_clear(cg, fn_name, pattern_vars);
+		} else if (!is_static_expr(cg, expr, pattern_vars)) {
+			/* static data is never unique, so its fields needn't be */
+			unique = unique_flags(cg, translate_identifier_name(fn_name));
+		}
+		list_for_each(
+			expr->v.application.expr_args, struct expr *,
+			if (unique != NULL && i < arity && unique[i] &&
+			    !is_unique_expr(cg, _value, unique_vars, pattern_vars)) {
+				unique[i] = 0;
+				is_change = 1;
+			} i++;
+			is_change |= reuse_update_expr(cg, _value, unique_vars, pattern_vars));
+		return is_change;
+	}
+	default: return 0;
+	}
+}
+
+static int reuse_update_clause(struct code_generator *cg,
+                               struct value *value,
+                               struct def_value *def_value) {
+	struct set *pattern_vars = set_new();
+	struct set *unique_vars  = set_new();
+	int is_change;
+	size_t i = 0;
+
+	list_for_each(def_value->expr_params,
+	              struct expr *,
+	              collect_pattern_vars(_value, pattern_vars));
+	list_for_each(def_value->expr_params,
+	              struct expr *,
+	              add_unique_vars(cg,
+	                              _value,
+	                              value->unique_params[i++],
+	                              def_value->value,
+	                              unique_vars));
+	is_change =
+		reuse_update_expr(cg, def_value->value, unique_vars, pattern_vars);
+	if (value->is_result_unique &&
+	    !is_unique_expr(cg, def_value->value, unique_vars, pattern_vars)) {
+		value->is_result_unique = 0;
+		is_change               = 1;
+	}
+	set_free(pattern_vars);
+	set_free(unique_vars);
+	return is_change;
+}
+
+static int reuse_update(struct code_generator *cg, struct value *value) {
+	int is_change = 0;
+	if (value->unique_params == NULL) {
+		/* top level values are shared, but still pass things on */
+		struct def_value *def_value = list_head(value->def_values);
+		struct set *empty           = set_new();
+		is_change = reuse_update_expr(cg, def_value->value, empty, empty);
+		set_free(empty);
+		return is_change;
+	}
+	list_for_each(value->def_values,
+	              struct def_value *,
+	              is_change |= reuse_update_clause(cg, value, _value));
+	return is_change;
+}
+
+static void owned_fields_init(struct code_generator *cg,
+                              char *constructor_name,
+                              size_t arity) {
+	char *owned;
+	if (arity == 0) {
+		return;
+	}
+	owned = arena_push_array_zero(cg->arena, arity, char);
+	memset(owned, 1, arity);
+	map_put_str(cg->owned_fields, constructor_name, owned);
+}
+
+static void reuse_init(struct code_generator *cg, struct value *value) {
+	size_t arity = value_arity(value);
+	if (arity > 0) {
+		value->unique_params = arena_push_array_zero(cg->arena, arity, char);
+		memset(value->unique_params, 1, arity);
+		value->is_result_unique = 1;
+	}
+}
+
+/* data nothing else refers to is built over once a case has matched it,
+ * rather than being left as garbage. starts from every function's params and
+ * result and every constructor's fields being unique, then clears those some
+ * use might share until nothing changes: params some call passes a shared
+ * value, results some clause returns one, and fields some data built at runtime
+ * is given one. variables are unique when used at most once, and bound to a
+ * unique param or an owned field of unique data */
+static void reuse_analyse(struct code_generator *cg) {
+	int is_change = 1;
+	map_for_each(
+		cg->constructors,
+		struct dec_constructor *,
+		owned_fields_init(cg, _value->name, list_length(_value->type_params)));
+	owned_fields_init(cg, "Cons", 2);
+	map_for_each(cg->values, struct value *, reuse_init(cg, _value));
+	while (is_change) {
+		is_change = 0;
+		map_for_each(cg->values,
+		             struct value *,
+		             is_change |= reuse_update(cg, _value));
+	}
+}
+
+/* a cell matched earlier in the case which can be built over by a constructor,
+ * taken so it is only built over once */
+static struct reuse_cell *reuse_cell_take(struct code_generator *cg,
+                                          char *constructor_name) {
+	struct list_iter iter;
+	if (cg->reuse_cells == NULL) {
+		return NULL;
+	}
+	iter = list_iterate(cg->reuse_cells);
+	while (!list_iter_at_end(&iter)) {
+		struct reuse_cell *reuse_cell = list_iter_next(&iter);
+		if (strcmp(reuse_cell->constructor_name, constructor_name) == 0) {
+			return list_iter_remove_curr(&iter);
+		}
+	}
+	return NULL;
+}
+
+static int
+is_unboxed_param(struct code_generator *cg, struct value *value, size_t i) {
+	return value->has_worker && value->strict_params[i] &&
+	       is_unboxed_type(cg, function_param_type(value->dec_type->type, i));
+}
+
+/* suffix names the worker's body when it runs in a letregion */
+static void code_gen_worker_signature(struct code_generator *cg,
+                                      struct value *value,
+                                      char *suffix) {
+	struct type *type = value->dec_type->type;
+	size_t arity      = value_arity(value);
+	size_t i;
+
+	code_gen_unboxed_type(cg, function_type_at(type, arity));
+	fprintf(cg->fptr, " fn_%s_w%s(", value->dec_type->name, suffix);
+	for (i = 0; i < arity; i++) {
+		if (is_unboxed_param(cg, value, i)) {
+			code_gen_unboxed_type(cg, function_param_type(type, i));
+			fprintf(cg->fptr, " v_%ld, ", i + 1);
+		} else {
+			fprintf(cg->fptr, "struct thunk *v_%ld, ", i + 1);
+		}
+	}
+	fprintf(cg->fptr, "struct region *region)");
+}
+
+/* a letregion worker taking only immediates unboxed renews its region each
+ * time it loops, as nothing the next iteration is given can point into it */
+static int is_renewing_region(struct code_generator *cg, struct value *value) {
+	struct type *type = value->dec_type->type;
+	size_t arity      = value_arity(value);
+	size_t i;
+	if (!value->dec_type->letregion) {
+		return 0;
+	}
+	for (i = 0; i < arity; i++) {
+		if (!is_unboxed_param(cg, value, i) ||
+		    !is_immediate_type(cg, function_param_type(type, i))) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static vid code_gen_strict_expr(struct code_generator *cg,
+                                struct expr *expr,
+                                struct type *type,
+                                vid *vid_state,
+                                struct set *param_vars);
+
+/* whether expr calls fn_name anywhere in it */
+static int is_calling(struct expr *expr, char *fn_name) {
+	struct list_iter iter;
+	if (expr->expr_type != EXPR_APPLICATION) {
+		return 0;
+	}
+	if (strcmp(expr->v.application.fn, fn_name) == 0) {
+		return 1;
+	}
+	iter = list_iterate(expr->v.application.expr_args);
+	while (!list_iter_at_end(&iter)) {
+		if (is_calling(list_iter_next(&iter), fn_name)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* whether expr refers to name, outside the values it let binds */
+static int refers_to(struct expr *expr, char *name) {
+	struct list_iter iter;
+	switch (expr->expr_type) {
+	case EXPR_IDENTIFIER: return strcmp(expr->v.identifier, name) == 0;
+	case EXPR_GROUPING: return refers_to(expr->v.grouping, name);
+	case EXPR_LET_IN: return refers_to(expr->v.let_in.value, name);
+	case EXPR_APPLICATION:
+		if (strcmp(expr->v.application.fn, name) == 0) {
+			return 1;
+		}
+		iter = list_iterate(expr->v.application.expr_args);
+		while (!list_iter_at_end(&iter)) {
+			if (refers_to(list_iter_next(&iter), name)) {
+				return 1;
+			}
+		}
+		return 0;
+	default: return 0;
+	}
+}
+
+static int is_sparking(struct value *value) {
+	struct list_iter iter = list_iterate(value->def_values);
+	while (!list_iter_at_end(&iter)) {
+		struct def_value *def_value = list_iter_next(&iter);
+		if (refers_to(def_value->value, "par")) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* whether evaluating expr calls something costly. calls of anything else take
+ * time bounded by the size of the program, too little to be worth a spark */
+static int is_costly(struct code_generator *cg, struct expr *expr) {
+	struct value *value;
+	struct list_iter iter;
+	switch (expr->expr_type) {
+	case EXPR_GROUPING: return is_costly(cg, expr->v.grouping);
+	case EXPR_LET_IN: return is_costly(cg, expr->v.let_in.value);
+	case EXPR_APPLICATION:
+		value = map_get_str(cg->values, expr->v.application.fn);
+		if (value != NULL && value->is_costly) {
+			return 1;
+		}
+		iter = list_iterate(expr->v.application.expr_args);
+		while (!list_iter_at_end(&iter)) {
+			if (is_costly(cg, list_iter_next(&iter))) {
+				return 1;
+			}
+		}
+		return 0;
+	default: return 0;
+	}
+}
+
+/* whether some clause of value calls target, directly or not */
+static int value_reaches(struct code_generator *cg,
+                         struct value *value,
+                         char *target,
+                         struct set *visited);
+
+static int expr_reaches(struct code_generator *cg,
+                        struct expr *expr,
+                        char *target,
+                        struct set *visited) {
+	char *name;
+	struct value *value;
+	struct list_iter iter;
+	switch (expr->expr_type) {
+	case EXPR_IDENTIFIER: name = expr->v.identifier; break;
+	case EXPR_APPLICATION: name = expr->v.application.fn; break;
+	case EXPR_GROUPING:
+		return expr_reaches(cg, expr->v.grouping, target, visited);
+	case EXPR_LET_IN:
+		return expr_reaches(cg, expr->v.let_in.value, target, visited);
+	default: return 0;
+	}
+	value = map_get_str(cg->values, name);
+	if (strcmp(name, target) == 0 ||
+	    (value != NULL && !set_has_str(visited, name) &&
+	     value_reaches(cg, value, target, visited))) {
+		return 1;
+	}
+	if (expr->expr_type == EXPR_IDENTIFIER) {
+		return 0;
+	}
+	iter = list_iterate(expr->v.application.expr_args);
+	while (!list_iter_at_end(&iter)) {
+		if (expr_reaches(cg, list_iter_next(&iter), target, visited)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static int value_reaches(struct code_generator *cg,
+                         struct value *value,
+                         char *target,
+                         struct set *visited) {
+	struct list_iter iter = list_iterate(value->def_values);
+	set_put_str(visited, value->dec_type->name);
+	while (!list_iter_at_end(&iter)) {
+		struct def_value *def_value = list_iter_next(&iter);
+		if (expr_reaches(cg, def_value->value, target, visited)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* recursive functions are costly, as are those calling them */
+static void cost_init(struct code_generator *cg, struct value *value) {
+	struct set *visited = set_new();
+	value->is_costly    = value_reaches(cg, value, value->dec_type->name, visited);
+	set_free(visited);
+}
+
+/* only ever sets is_costly, so the analysis finishes */
+static int cost_update(struct code_generator *cg, struct value *value) {
+	struct list_iter iter = list_iterate(value->def_values);
+	if (value->is_costly) {
+		return 0;
+	}
+	while (!value->is_costly && !list_iter_at_end(&iter)) {
+		struct def_value *def_value = list_iter_next(&iter);
+		value->is_costly            = is_costly(cg, def_value->value);
+	}
+	return value->is_costly;
+}
+
+static void cost_analyse(struct code_generator *cg) {
+	int is_change = 1;
+	map_for_each(cg->values, struct value *, cost_init(cg, _value));
+	while (is_change) {
+		is_change = 0;
+		map_for_each(cg->values,
+		             struct value *,
+		             if (cost_update(cg, _value)) is_change = 1;);
+	}
+}
+
+/* generates a costly strict arg as a thunk sparked for another worker, when
+ * the runtime wants one, returning the vid of the thunk, else NULL. it is
+ * joined by code_gen_spark_join once the args after it are evaluated */
+static vid code_gen_spark(struct code_generator *cg,
+                          struct expr *expr,
+                          vid *vid_state,
+                          struct set *param_vars) {
+	vid spark_vid      = vid_next(vid_state);
+	int is_frame_local = cg->is_frame_local;
+	int is_allocating  = cg->is_allocating;
+	fprintf(cg->fptr, "\tstruct thunk *v_%ld = NULL;\n", spark_vid);
+	fprintf(cg->fptr, "\tif (spark_wanted()) {\n");
+	/* a worker finding it evaluated still reads it, maybe once the frame has
+	 * returned. sparks are few, so don't need a letregion of their own, which
+	 * every call would pay for */
+	cg->is_frame_local = 0;
+	code_gen_expr(cg, expr, vid_state, param_vars);
+	cg->is_frame_local = is_frame_local;
+	cg->is_allocating  = is_allocating;
+	fprintf(cg->fptr, "\t\tv_%ld = v_%ld;\n", spark_vid, vid_curr(vid_state));
+	fprintf(cg->fptr, "\t\tspark(v_%ld);\n", spark_vid);
+	fprintf(cg->fptr, "\t}\n");
+	return spark_vid;
+}
+
+/* the value of the sparked thunk, or of the arg evaluated here when it wasn't
+ * sparked */
+static vid code_gen_spark_join(struct code_generator *cg,
+                               struct expr *expr,
+                               struct type *type,
+                               vid spark_vid,
+                               vid *vid_state,
+                               struct set *param_vars) {
+	vid value_vid = vid_next(vid_state);
+	fprintf(cg->fptr, "\t");
+	code_gen_unboxed_type(cg, type);
+	fprintf(cg->fptr, " v_%ld;\n", value_vid);
+	fprintf(cg->fptr, "\tif (v_%ld != NULL) {\n", spark_vid);
+	fprintf(cg->fptr, "\t\tv_%ld = thunk_eval(v_%ld, ", value_vid, spark_vid);
+	code_gen_unboxed_type(cg, type);
+	fprintf(cg->fptr, ");\n");
+	fprintf(cg->fptr, "\t} else {\n");
+	fprintf(cg->fptr,
+	        "\t\tv_%ld = v_%ld;\n",
+	        value_vid,
+	        code_gen_strict_expr(cg, expr, type, vid_state, param_vars));
+	fprintf(cg->fptr, "\t}\n");
+	return value_vid;
+}
+
+/* how many of the strict args of a saturated call to a worker are costly, when
+ * they are sparked */
+static size_t costly_args(struct code_generator *cg,
+                          struct value *callee,
+                          struct expr *expr) {
+	struct list_iter args_iter = list_iterate(expr->v.application.expr_args);
+	size_t costly              = 0;
+	size_t i;
+	if (cg->par_mode != PAR_AUTO) {
+		return 0;
+	}
+	for (i = 0; !list_iter_at_end(&args_iter); i++) {
+		struct expr *arg = list_iter_next(&args_iter);
+		if (is_unboxed_param(cg, callee, i) && is_costly(cg, arg)) {
+			costly++;
+		}
+	}
+	return costly;
+}
+
+/* generates the args of a saturated call to a worker, returning their vids.
+ * when they rebind the params of a loop, immediates carry nothing built for
+ * them round it, so can be built from objects in the C stack frame */
+static vid *code_gen_worker_args(struct code_generator *cg,
+                                 struct value *callee,
+                                 struct expr *expr,
+                                 vid *vid_state,
+                                 struct set *param_vars,
+                                 int is_loop) {
+	struct type *type          = callee->dec_type->type;
+	vid *arg_vids              = calloc(value_arity(callee), sizeof(vid));
+	char *is_sparked           = calloc(value_arity(callee), sizeof(char));
+	size_t sparks              = costly_args(cg, callee, expr);
+	struct list_iter args_iter = list_iterate(expr->v.application.expr_args);
+	size_t i;
+
+	/* all but the last costly arg are sparked, so the others are evaluated
+	 * alongside them */
+	sparks = sparks > 0 ? sparks - 1 : 0;
+	for (i = 0; !list_iter_at_end(&args_iter); i++) {
+		struct expr *arg = list_iter_next(&args_iter);
+		if (sparks > 0 && is_unboxed_param(cg, callee, i) &&
+		    is_costly(cg, arg)) {
+			arg_vids[i]   = code_gen_spark(cg, arg, vid_state, param_vars);
+			is_sparked[i] = 1;
+			sparks--;
+		} else if (is_unboxed_param(cg, callee, i)) {
+			struct type *param_type = function_param_type(type, i);
+			if (is_loop) {
+				cg->is_frame_local = !cg->is_sparking &&
+				                     is_immediate_type(cg, param_type) &&
+				                     !is_calling(arg, callee->dec_type->name);
+			}
+			arg_vids[i] =
+				code_gen_strict_expr(cg, arg, param_type, vid_state, param_vars);
+			if (is_loop) {
+				cg->is_frame_local = 0;
+			}
+		} else {
+			code_gen_expr(cg, arg, vid_state, param_vars);
+			arg_vids[i] = vid_curr(vid_state);
+		}
+	}
+	for (i = 0; i < value_arity(callee); i++) {
+		if (is_sparked[i]) {
+			arg_vids[i] =
+				code_gen_spark_join(cg,
+				                    list_get(expr->v.application.expr_args, i),
+				                    function_param_type(type, i),
+				                    arg_vids[i],
+				                    vid_state,
+				                    param_vars);
+		}
+	}
+	free(is_sparked);
+	return arg_vids;
+}
+
+/* calls a worker directly, unless the C stack is running low. then the call
+ * goes through a thunk, so evaluation carries on in a new stack segment */
+static vid code_gen_worker_call(struct code_generator *cg,
+                                struct value *callee,
+                                struct expr *expr,
+                                vid *vid_state,
+                                struct set *param_vars) {
+	struct type *type   = callee->dec_type->type;
+	size_t arity        = value_arity(callee);
+	struct type *result = function_type_at(type, arity);
+	vid *arg_vids =
+		code_gen_worker_args(cg, callee, expr, vid_state, param_vars, 0);
+	vid value_vid = vid_next(vid_state);
+	size_t i;
+
+	/* the callee allocates in the caller's region, unless it has its own */
+	if (!callee->dec_type->letregion) {
+		cg->is_allocating = 1;
+	}
+
+	fprintf(cg->fptr, "\t");
+	code_gen_unboxed_type(cg, result);
+	fprintf(cg->fptr, " v_%ld;\n", value_vid);
+	fprintf(cg->fptr, "\tif (eval_stack_low()) {\n");
+	fprintf(cg->fptr, "\t\tv_%ld = (", value_vid);
+	code_gen_unboxed_type(cg, result);
+	fprintf(cg->fptr,
+	        ")_thunk_eval(thunk_call(fn_%s, region, &info_%s, %ld",
+	        callee->dec_type->name,
+	        translate_info_name(result),
+	        arity);
+	for (i = 0; i < arity; i++) {
+		if (is_unboxed_param(cg, callee, i)) {
+			fprintf(cg->fptr,
+			        ", thunk_lit((void *)v_%ld, region, &info_%s)",
+			        arg_vids[i],
+			        translate_info_name(function_param_type(type, i)));
+		} else {
+			fprintf(cg->fptr, ", v_%ld", arg_vids[i]);
+		}
+	}
+	fprintf(cg->fptr, "));\n");
+	fprintf(cg->fptr, "\t} else {\n");
+	fprintf(cg->fptr, "\t\tv_%ld = fn_%s_w(", value_vid, callee->dec_type->name);
+	for (i = 0; i < arity; i++) {
+		fprintf(cg->fptr, "v_%ld, ", arg_vids[i]);
+	}
+	fprintf(cg->fptr, "region);\n");
+	fprintf(cg->fptr, "\t}\n");
+	free(arg_vids);
+	return value_vid;
+}
+
+/* builds a saturated constructor. user defined ones are built by their worker,
+ * with their unboxed fields generated strictly. data the case matched which
+ * nothing else refers to is built over instead, when it has the same
+ * constructor */
+static vid code_gen_strict_constructor(struct code_generator *cg,
+                                       struct expr *expr,
+                                       struct type *type,
+                                       vid *vid_state,
+                                       struct set *param_vars) {
+	char *fn_name   = translate_identifier_name(expr->v.application.fn);
+	size_t args_len = list_length(expr->v.application.expr_args);
+	struct dec_constructor *dec_constructor =
+		map_get_str(cg->constructors, fn_name);
+	struct list_iter args_iter = list_iterate(expr->v.application.expr_args);
+	vid *arg_vids              = calloc(args_len, sizeof(vid));
+	struct reuse_cell *reuse_cell;
+	vid value_vid;
+	size_t i;
+
+	for (i = 0; i < args_len; i++) {
+		struct expr *arg = list_iter_next(&args_iter);
+		if (is_unboxed_field(cg, dec_constructor, i)) {
+			struct type *field_type = list_get(dec_constructor->type_params, i);
+			arg_vids[i] =
+				code_gen_strict_expr(cg, arg, field_type, vid_state, param_vars);
+		} else {
+			code_gen_expr(cg, arg, vid_state, param_vars);
+			arg_vids[i] = vid_curr(vid_state);
+		}
+	}
+
+	value_vid = vid_next(vid_state);
+	if (dec_constructor != NULL && cg->is_frame_local) {
+		fprintf(cg->fptr,
+		        "\tstruct data_%s d_%ld;\n",
+		        translate_type_name(type->name),
+		        value_vid);
+		fprintf(cg->fptr, "\t");
+		code_gen_unboxed_type(cg, type);
+		fprintf(cg->fptr,
+		        " v_%ld = fn_%s_init(&d_%ld",
+		        value_vid,
+		        fn_name,
+		        value_vid);
+		for (i = 0; i < args_len; i++) {
+			fprintf(cg->fptr, ", v_%ld", arg_vids[i]);
+		}
+		fprintf(cg->fptr, ");\n");
+		free(arg_vids);
+		return value_vid;
+	}
+
+	reuse_cell = reuse_cell_take(cg, fn_name);
+	if (reuse_cell != NULL) {
+		fprintf(cg->fptr, "\t");
+		code_gen_unboxed_type(cg, type);
+		fprintf(cg->fptr,
+		        " v_%ld = fn_%s_init(v_%ld",
+		        value_vid,
+		        fn_name,
+		        reuse_cell->vid);
+		for (i = 0; i < args_len; i++) {
+			fprintf(cg->fptr, ", v_%ld", arg_vids[i]);
+		}
+		fprintf(cg->fptr, ");\n");
+		if (cg->gc_mode == GC_COPYING) {
+			/* the cell may be older than its new fields */
+			fprintf(cg->fptr, "\tgc_remember(v_%ld);\n", reuse_cell->vid);
+		}
+		free(arg_vids);
+		return value_vid;
+	}
+
+	cg->is_allocating = 1;
+	fprintf(cg->fptr, "\t");
+	code_gen_unboxed_type(cg, type);
+	if (dec_constructor != NULL) {
+		fprintf(cg->fptr, " v_%ld = fn_%s_w(", value_vid, fn_name);
+		for (i = 0; i < args_len; i++) {
+			fprintf(cg->fptr, "v_%ld, ", arg_vids[i]);
+		}
+		fprintf(cg->fptr, "region);\n");
+	} else {
+		fprintf(
+			cg->fptr, " v_%ld = fn_%s((struct thunk *[]){", value_vid, fn_name);
+		for (i = 0; i < args_len; i++) {
+			fprintf(cg->fptr, i == 0 ? "v_%ld" : ", v_%ld", arg_vids[i]);
+		}
+		fprintf(cg->fptr, "}, region);\n");
+	}
+	free(arg_vids);
+	return value_vid;
+}
+
+/* generates expr where its value is needed straight away, as an unboxed value
+ * of type, returning its vid */
+static vid code_gen_strict_expr(struct code_generator *cg,
+                                struct expr *expr,
+                                struct type *type,
+                                vid *vid_state,
+                                struct set *param_vars) {
+	vid value_vid;
+	vid thunk_vid;
+
+	switch (expr->expr_type) {
+	case EXPR_LIT_INT:
+	case EXPR_LIT_CHAR:
+		value_vid = vid_next(vid_state);
+		fprintf(cg->fptr, "\t");
+		code_gen_unboxed_type(cg, type);
+		fprintf(cg->fptr,
+		        " v_%ld = %d;\n",
+		        value_vid,
+		        expr->expr_type == EXPR_LIT_INT ? expr->v.lit_int
+		                                        : expr->v.lit_char);
+		return value_vid;
+	case EXPR_IDENTIFIER: {
+		struct worker_var *worker_var =
+			map_get_str(cg->worker_vars, expr->v.identifier);
+		struct dec_constructor *dec_constructor =
+			map_get_str(cg->constructors, expr->v.identifier);
+		if (dec_constructor != NULL &&
+		    list_length(dec_constructor->type_params) == 0) {
+			/* nullary constructor, an immediate */
+			value_vid = vid_next(vid_state);
+			fprintf(cg->fptr, "\t");
+			code_gen_unboxed_type(cg, type);
+			fprintf(cg->fptr,
+			        " v_%ld = %s;\n",
+			        value_vid,
+			        code_gen_nullary(cg,
+			                         translate_type_name(type->name),
+			                         expr->v.identifier));
+			return value_vid;
+		}
+		if (worker_var == NULL) {
+			break;
+		}
+		value_vid = vid_next(vid_state);
+		fprintf(cg->fptr, "\t");
+		code_gen_unboxed_type(cg, type);
+		fprintf(cg->fptr, " v_%ld = v_%ld;\n", value_vid, worker_var->vid);
+		return value_vid;
+	}
+	case EXPR_LIST_NULL:
+		value_vid = vid_next(vid_state);
+		fprintf(cg->fptr, "\t");
+		code_gen_unboxed_type(cg, type);
+		fprintf(cg->fptr,
+		        " v_%ld = %s;\n",
+		        value_vid,
+		        code_gen_nullary(cg, "List", "Null"));
+		return value_vid;
+	case EXPR_APPLICATION: {
+		char *fn_name   = expr->v.application.fn;
+		size_t args_len = list_length(expr->v.application.expr_args);
+		struct value *callee;
+
+		if (static_expr_name(cg, expr) != NULL ||
+		    set_has_str(param_vars, fn_name)) {
+			break;
+		}
+		if (is_arithmetic(fn_name) && args_len == 2) {
+			struct expr *lhs = list_head(expr->v.application.expr_args);
+			struct expr *rhs = list_last(expr->v.application.expr_args);
+			vid lhs_vid;
+			vid rhs_vid;
+			if (cg->par_mode == PAR_AUTO && is_costly(cg, lhs) &&
+			    is_costly(cg, rhs)) {
+				vid spark_vid = code_gen_spark(cg, lhs, vid_state, param_vars);
+				rhs_vid = code_gen_strict_expr(cg, rhs, type, vid_state, param_vars);
+				lhs_vid = code_gen_spark_join(
+					cg, lhs, type, spark_vid, vid_state, param_vars);
+			} else {
+				lhs_vid = code_gen_strict_expr(cg, lhs, type, vid_state, param_vars);
+				rhs_vid = code_gen_strict_expr(cg, rhs, type, vid_state, param_vars);
+			}
+			value_vid = vid_next(vid_state);
+			fprintf(cg->fptr, "\t");
+			code_gen_unboxed_type(cg, type);
+			fprintf(cg->fptr,
+			        " v_%ld = v_%ld %s v_%ld;\n",
+			        value_vid,
+			        lhs_vid,
+			        fn_name,
+			        rhs_vid);
+			return value_vid;
+		}
+		callee = map_get_str(cg->values, fn_name);
+		if (callee != NULL && callee->has_worker &&
+		    args_len == value_arity(callee)) {
+			return code_gen_worker_call(cg, callee, expr, vid_state, param_vars);
+		}
+		fn_name = translate_identifier_name(fn_name);
+		if (isupper(fn_name[0]) && args_len > 0 &&
+		    args_len == known_arity(cg, fn_name, NULL)) {
+			/* saturated constructor, built straight away */
+			return code_gen_strict_constructor(
+				cg, expr, type, vid_state, param_vars);
+		}
+		break;
+	}
+	default: break;
+	}
+
+	/* anything else is built as a thunk, then evaluated */
+	code_gen_expr(cg, expr, vid_state, param_vars);
+	thunk_vid = vid_curr(vid_state);
+	value_vid = vid_next(vid_state);
+	fprintf(cg->fptr, "\t");
+	code_gen_unboxed_type(cg, type);
+	fprintf(cg->fptr, " v_%ld = thunk_eval(v_%ld, ", value_vid, thunk_vid);
+	code_gen_unboxed_type(cg, type);
+	fprintf(cg->fptr, ");\n");
+	return value_vid;
+}
+
+/* the result of one case of a worker. calls back to itself rebind the params
+ * and loop. otherwise, when the result is an immediate, nothing built for it
+ * can be reached once the case returns: whatever refers to an object was built
+ * after it, thunks being updated only with what their own closure reaches. so
+ * those objects go in the C stack frame, which the loop would leave. not when
+ * the case recurses, as each frame would then hold its objects for as long as
+ * the region does, and the C compiler can no longer turn the recursion into a
+ * loop */
+static void code_gen_worker_tail(struct code_generator *cg,
+                                 struct value *value,
+                                 struct expr *expr,
+                                 vid *vid_state,
+                                 struct set *param_vars) {
+	size_t arity      = value_arity(value);
+	struct type *type = function_type_at(value->dec_type->type, arity);
+
+	if (expr->expr_type == EXPR_APPLICATION &&
+	    static_expr_name(cg, expr) == NULL &&
+	    strcmp(expr->v.application.fn, value->dec_type->name) == 0 &&
+	    !set_has_str(param_vars, expr->v.application.fn) &&
+	    list_length(expr->v.application.expr_args) == arity) {
+		vid *arg_vids =
+			code_gen_worker_args(cg, value, expr, vid_state, param_vars, 1);
+		size_t i;
+		/* the first vids are the function params */
+		for (i = 0; i < arity; i++) {
+			fprintf(cg->fptr, "\tv_%ld = v_%ld;\n", i + 1, arg_vids[i]);
+		}
+		if (is_renewing_region(cg, value)) {
+			fprintf(cg->fptr, "\tfn_%s_w_renew(region);\n", value->dec_type->name);
+		}
+		fprintf(cg->fptr, "\tgoto case_0;\n");
+		free(arg_vids);
+		return;
+	}
+
+	cg->is_frame_local = !cg->is_sparking && is_immediate_type(cg, type) &&
+	                     !is_calling(expr, value->dec_type->name);
+	fprintf(cg->fptr,
+	        "\treturn v_%ld;\n",
+	        code_gen_strict_expr(cg, expr, type, vid_state, param_vars));
+	cg->is_frame_local = 0;
+}
+
+/* unboxed params matched by a variable are used as they are */
+static void add_worker_var(struct code_generator *cg,
+                           struct value *value,
+                           struct expr *pattern,
+                           size_t param_index) {
+	struct worker_var *worker_var;
+	while (pattern->expr_type == EXPR_GROUPING) {
+		pattern = pattern->v.grouping;
+	}
+	if (!is_unboxed_param(cg, value, param_index) ||
+	    pattern->expr_type != EXPR_IDENTIFIER ||
+	    !islower(pattern->v.identifier[0])) {
+		return;
+	}
+	worker_var       = arena_push_struct_zero(cg->arena, struct worker_var);
+	worker_var->vid  = param_index + 1;
+	worker_var->type = function_param_type(value->dec_type->type, param_index);
+	map_put_str(cg->worker_vars, pattern->v.identifier, worker_var);
+}
+
+static void code_gen_worker_case(struct code_generator *cg,
+                                 struct value *value,
+                                 struct def_value *def_value,
+                                 char *unboxed_params,
+                                 size_t next_case_index,
+                                 vid *vid_state) {
+	struct set *param_vars = set_new();
+	size_t i               = 0;
+
+	cg->worker_vars = map_new();
+	cg->reuse_cells = list_new(NULL);
+	list_for_each(def_value->expr_params,
+	              struct expr *,
+	              add_worker_var(cg, value, _value, i++));
+	code_gen_pattern_check_case(cg,
+	                            def_value->expr_params,
+	                            vid_state,
+	                            next_case_index,
+	                            param_vars,
+	                            unboxed_params,
+	                            value->unique_params);
+	code_gen_worker_tail(cg, value, def_value->value, vid_state, param_vars);
+	map_free(cg->worker_vars);
+	cg->worker_vars = NULL;
+	list_free(cg->reuse_cells);
+	cg->reuse_cells = NULL;
+	set_free(param_vars);
+}
+
+static void code_gen_unmatched_case(struct code_generator *cg,
+                                    char *name,
+                                    size_t case_index) {
+	fprintf(cg->fptr, "case_%ld : {\n", case_index);
+	fprintf(cg->fptr, "\tprintf(\"Unmatched pattern in function '");
+	fprintf(cg->fptr, "%s", name);
+	fprintf(cg->fptr, "'\");\n");
+	fprintf(cg->fptr, "\texit(1);\n");
+	fprintf(cg->fptr, "}\n");
+}
+
+/* runs the worker's body in a region of its own, freed when it returns. the
+ * result is unboxed, so nothing allocated in the region outlives it. a body
+ * which never uses its region is called as it is */
+static void code_gen_worker_letregion(struct code_generator *cg,
+                                      struct value *value) {
+	size_t arity = value_arity(value);
+	size_t i;
+
+	code_gen_worker_signature(cg, value, "");
+	fprintf(cg->fptr, " {\n");
+	if (!cg->is_allocating) {
+		fprintf(cg->fptr, "\treturn fn_%s_w_in(", value->dec_type->name);
+		for (i = 0; i < arity; i++) {
+			fprintf(cg->fptr, "v_%ld, ", i + 1);
+		}
+		fprintf(cg->fptr, "region);\n");
+		fprintf(cg->fptr, "}\n");
+		return;
+	}
+	fprintf(cg->fptr, "\tstruct region *scope = region_enter();\n");
+	fprintf(cg->fptr, "\t");
+	code_gen_unboxed_type(cg, function_type_at(value->dec_type->type, arity));
+	fprintf(cg->fptr, " result = fn_%s_w_in(", value->dec_type->name);
+	for (i = 0; i < arity; i++) {
+		fprintf(cg->fptr, "v_%ld, ", i + 1);
+	}
+	fprintf(cg->fptr, "scope);\n");
+	fprintf(cg->fptr, "\t(void)region;\n");
+	fprintf(cg->fptr, "\tregion_exit(scope);\n");
+	fprintf(cg->fptr, "\treturn result;\n");
+	fprintf(cg->fptr, "}\n");
+}
+
+/* frees what the last iteration allocated, when the body allocates in its
+ * region. otherwise the region is the caller's, and is left alone. renewing
+ * keeps the region where it is, so fn_X_w still exits the scope it entered */
+static void code_gen_worker_renew(struct code_generator *cg,
+                                  struct value *value) {
+	fprintf(cg->fptr,
+	        "static void fn_%s_w_renew(struct region *region) {\n",
+	        value->dec_type->name);
+	if (cg->is_allocating) {
+		fprintf(cg->fptr, "\tregion_renew(region);\n");
+	} else {
+		fprintf(cg->fptr, "\t(void)region;\n");
+	}
+	fprintf(cg->fptr, "}\n");
+}
+
+static void code_gen_worker(struct code_generator *cg, struct value *value) {
+	size_t arity           = value_arity(value);
+	char *unboxed_params   = calloc(arity, sizeof(char));
+	size_t next_case_index = 0;
+	vid _vid_state         = arity + 1; /* after the params */
+	size_t i;
+
+	for (i = 0; i < arity; i++) {
+		unboxed_params[i] = is_unboxed_param(cg, value, i);
+	}
+
+	if (is_renewing_region(cg, value)) {
+		fprintf(cg->fptr,
+		        "static void fn_%s_w_renew(struct region *region);\n",
+		        value->dec_type->name);
+	}
+	code_gen_worker_signature(
+		cg, value, value->dec_type->letregion ? "_in" : "");
+	fprintf(cg->fptr, " {\n");
+	fprintf(cg->fptr, "\tgoto case_0;\n");
+	cg->is_allocating = 0;
+	list_for_each(value->def_values,
+	              struct def_value *,
+	              fprintf(cg->fptr, "case_%ld : {\n", next_case_index++);
+	              code_gen_worker_case(cg,
+	                                   value,
+	                                   _value,
+	                                   unboxed_params,
+	                                   next_case_index,
+	                                   &_vid_state);
+	              fprintf(cg->fptr, "}\n"));
+	code_gen_unmatched_case(cg, value->dec_type->name, next_case_index);
+	fprintf(cg->fptr, "}\n");
+	free(unboxed_params);
+
+	if (is_renewing_region(cg, value)) {
+		code_gen_worker_renew(cg, value);
+	}
+	if (value->dec_type->letregion) {
+		code_gen_worker_letregion(cg, value);
+	}
+}
+
+/* the uniform entry point, evaluating the params the worker takes unboxed */
+static void code_gen_wrapper(struct code_generator *cg, struct value *value) {
+	struct type *type = value->dec_type->type;
+	size_t arity      = value_arity(value);
+	size_t i;
+
+	fprintf(cg->fptr,
+	        "void *fn_%s(struct thunk **args, struct region *region) {\n",
+	        value->dec_type->name);
+	fprintf(cg->fptr, "\treturn (void *)fn_%s_w(", value->dec_type->name);
+	for (i = 0; i < arity; i++) {
+		if (is_unboxed_param(cg, value, i)) {
+			fprintf(cg->fptr, "thunk_eval(args[%ld], ", i);
+			code_gen_unboxed_type(cg, function_param_type(type, i));
+			fprintf(cg->fptr, "), ");
+		} else {
+			fprintf(cg->fptr, "args[%ld], ", i);
+		}
+	}
+	fprintf(cg->fptr, "region);\n");
+	fprintf(cg->fptr, "}\n");
+}
+
+static void code_gen_case(struct code_generator *cg,
+                          struct value *value,
+                          struct def_value *def_value,
+                          size_t next_case_index,
+                          vid *vid_state) {
+	struct set *param_vars = set_new();
+	cg->worker_vars        = map_new();
+	code_gen_pattern_check_case(cg,
+	                            def_value->expr_params,
+	                            vid_state,
+	                            next_case_index,
+	                            param_vars,
+	                            NULL,
+	                            NULL);
+	code_gen_tail_expr(cg, value, def_value->value, vid_state, param_vars);
+	map_free(cg->worker_vars);
+	cg->worker_vars = NULL;
+	set_free(param_vars);
+}
+
+/* runs fn_name's body in a region of its own, freed when it returns. its
+ * result is evaluated and held in a register, so nothing in the region
+ * outlives it */
+static void code_gen_letregion(struct code_generator *cg, char *name) {
+	fprintf(cg->fptr,
+	        "void* fn_%s(struct thunk **args, struct region *region) {\n",
+	        name);
+	fprintf(cg->fptr, "\tstruct region *scope = region_enter();\n");
+	fprintf(cg->fptr, "\tvoid *result = fn_%s_in(args, scope);\n", name);
+	fprintf(cg->fptr, "\t(void)region;\n");
+	fprintf(cg->fptr, "\tregion_exit(scope);\n");
+	fprintf(cg->fptr, "\treturn result;\n");
+	fprintf(cg->fptr, "}\n");
+}
+
+static void code_gen_value(struct code_generator *cg, struct value *value) {
+	char *name   = value->dec_type->name;
+	size_t arity = list_length(
+		((struct def_value *)list_head(value->def_values))->expr_params);
+
+	vid _vid_state = 1;
+	vid *vid_state = &_vid_state;
+
+	if (arity == 0) {
+		struct def_value *value_def_value = list_head(value->def_values);
+		if (is_static_root(cg, value_def_value->value, NULL)) {
+			char *thunk_name = arena_push_array_zero(
+				cg->arena, strlen(name) + sizeof("_val_"), char);
+			sprintf(thunk_name, "_val_%s", name);
+			code_gen_static_expr(cg, value_def_value->value, thunk_name);
+			fprintf(cg->fptr, "struct thunk *val_%s = &_val_%s;\n", name, name);
+			fprintf(cg->fptr, "\n");
+			return;
+		}
+		code_gen_static_subexprs(cg, value_def_value->value, NULL);
+	} else {
+		list_for_each(value->def_values, struct def_value *,
+		              struct set *pattern_vars = set_new();
+		              list_for_each(_value->expr_params,
+		                            struct expr *,
+		                            collect_pattern_vars(_value, pattern_vars));
+		              code_gen_static_subexprs(cg, _value->value, pattern_vars);
+		              set_free(pattern_vars));
+	}
+
+	if (value->has_worker) {
+		code_gen_worker(cg, value);
+		code_gen_wrapper(cg, value);
+		code_gen_static_pap(cg, name, arity);
+		fprintf(cg->fptr, "\n");
+		return;
+	}
+
+	fprintf(cg->fptr,
+	        "void* fn_%s%s(struct thunk **args, struct region *region) {\n",
+	        name,
+	        value->dec_type->letregion ? "_in" : "");
+	fprintf(cg->fptr, "\tvoid* ret_thunk;\n");
+
+	if (arity == 0) {
+		struct def_value *value_def_value = list_head(value->def_values);
+		code_gen_tail_expr(cg, value, value_def_value->value, vid_state, NULL);
+	} else {
+		size_t i;
+		size_t next_case_index = 0;
+
+		/* setup variables for each arg */
+		/* first v_0 .. v_n variables are the arguments */
+		for (i = 0; i < arity; i++) {
+			fprintf(cg->fptr,
+			        "\tstruct thunk *v_%ld = args[%ld];\n",
+			        vid_next(vid_state),
 			        i);
 		}
 
 		fprintf(cg->fptr, "\tgoto case_0;\n");
 		/* generate each case */
-		list_for_each(
-			value->def_values, struct def_value *, struct set *param_vars = set_new();
-			fprintf(cg->fptr, "case_%ld : {\n", next_case_index++);
-			code_gen_pattern_check_case(
-				cg, _value->expr_params, vid_state, next_case_index, param_vars);
-			code_gen_expr(cg, _value->value, vid_state, param_vars);
-			fprintf(cg->fptr, "\tret_thunk = v_%ld;\n", vid_curr(vid_state));
-			fprintf(cg->fptr, "\tgoto ret;\n");
-			fprintf(cg->fptr, "}\n"));
+		list_for_each(value->def_values,
+		              struct def_value *,
+		              fprintf(cg->fptr, "case_%ld : {\n", next_case_index++);
+		              code_gen_case(cg, value, _value, next_case_index, vid_state);
+		              fprintf(cg->fptr, "}\n"));
 		/* error case if no matches */
 		fprintf(cg->fptr, "case_%ld : {\n", next_case_index);
 		fprintf(cg->fptr, "\tprintf(\"Unmatched pattern in function '");
@@ -666,42 +2960,85 @@ static void code_gen_value(struct code_generator *cg, struct value *value) {
 
 	fprintf(cg->fptr, "ret: {\n");
 	fprintf(cg->fptr, "\tvoid *ret_val = _thunk_eval(ret_thunk);\n");
-	list_for_each(value->thunks_to_release,
-	              char *,
-	              fprintf(cg->fptr, "\tthunk_release(val_%s);\n", _value));
+	/* let bound functions are static paps, there is nothing to release */
+	list_for_each(
+		value->thunks_to_release,
+		char *,
+		if (known_arity(cg, _value, NULL) == 0)
+			fprintf(cg->fptr, "\tthunk_release(val_%s);\n", _value));
 	fprintf(cg->fptr, "\treturn ret_val;\n");
 	fprintf(cg->fptr, "}\n");
 
 	fprintf(cg->fptr, "}\n"); /* end of function */
 
-	fprintf(cg->fptr, "struct closure _closure_%s = {\n", name);
-	fprintf(cg->fptr, "\t.fn_arity = %ld,\n", arity);
-	fprintf(cg->fptr, "\t.args_len = 0,\n");
-	fprintf(cg->fptr, "\t.fn       = &fn_%s,\n", name);
-	fprintf(cg->fptr, "\t.args     = NULL,\n");
-	fprintf(cg->fptr, "};\n");
+	if (value->dec_type->letregion) {
+		code_gen_letregion(cg, name);
+	}
 
-	fprintf(cg->fptr, "struct closure *closure_%s = &_closure_%s;\n", name, name);
+	if (arity > 0) {
+		code_gen_static_pap(cg, name, arity);
+	} else {
+		code_gen_caf(cg, value);
+	}
 
 	fprintf(cg->fptr, "\n");
 
 	return;
 }
 
+static void code_gen_worker_dec(struct code_generator *cg,
+                                struct value *value) {
+	if (value->has_worker) {
+		code_gen_worker_signature(cg, value, "");
+		fprintf(cg->fptr, ";\n");
+	}
+}
+
 static void code_gen_values(struct code_generator *cg) {
+	if (cg->opt_level != OPT_NONE) {
+		map_for_each(cg->values,
+		             struct value *,
+		             cg->is_sparking = cg->is_sparking || is_sparking(_value));
+		worker_analyse(cg);
+		if (cg->par_mode == PAR_AUTO) {
+			cost_analyse(cg);
+		}
+		reuse_analyse(cg);
+		map_for_each(cg->values, struct value *, code_gen_worker_dec(cg, _value));
+		fprintf(cg->fptr, "\n");
+	}
 	map_for_each(cg->values, struct value *, code_gen_value(cg, _value));
 }
 
+/* the top level value thunks, which the collector takes as roots */
+static void code_gen_gc_roots(struct code_generator *cg) {
+	fprintf(cg->fptr, "struct thunk *gc_roots[] = {\n");
+	list_for_each(
+		cg->cafs, char *, fprintf(cg->fptr, "\t&_val_%s,\n", _value));
+	fprintf(cg->fptr, "\tNULL,\n");
+	fprintf(cg->fptr, "};\n");
+	fprintf(cg->fptr, "\n");
+}
+
 static void code_gen_main(struct code_generator *cg) {
+	if (cg->gc_mode == GC_COPYING) {
+		code_gen_gc_roots(cg);
+	}
 	fprintf(cg->fptr, "int main(void) {\n");
-	fprintf(cg->fptr, "\tr_global.arena           = arena_alloc();\n");
+	if (cg->gc_mode == GC_COPYING) {
+		fprintf(cg->fptr, "\tchar stack_top;\n");
+		fprintf(cg->fptr, "\tgc_init(&stack_top, gc_roots);\n");
+	}
 	fprintf(cg->fptr, "\tr_global.reference_count = 0;\n");
-	/* TODO use actual region for main */
-	fprintf(
-		cg->fptr,
-		"\tval_main = thunk_closure(closure_main, &r_global, value_copy_Int);\n");
+	fprintf(cg->fptr, "\tr_global.is_static       = 1;\n");
 	fprintf(cg->fptr, "\tint ret_val = thunk_eval(val_main, int);\n");
 	fprintf(cg->fptr, "\tprintf(\"%%d\\n\", ret_val);\n");
+	fprintf(cg->fptr, "\tif (getenv(\"RACC_STATS\") != NULL) {\n");
+	fprintf(cg->fptr, "\t\teval_stats_print();\n");
+	if (cg->gc_mode == GC_COPYING) {
+		fprintf(cg->fptr, "\t\tgc_stats_print();\n");
+	}
+	fprintf(cg->fptr, "\t}\n");
 	fprintf(cg->fptr, "\treturn 0;\n");
 	fprintf(cg->fptr, "}\n");
 }
@@ -709,7 +3046,10 @@ static void code_gen_main(struct code_generator *cg) {
 void code_gen(struct prog *prog,
               struct arena *arena,
               struct error_log *log,
-              char *file_name) {
+              char *file_name,
+              enum opt_level opt_level,
+              enum gc_mode gc_mode,
+              enum par_mode par_mode) {
 	struct code_generator *cg =
 		arena_push_struct_zero(arena, struct code_generator);
 
@@ -719,6 +3059,15 @@ void code_gen(struct prog *prog,
 	cg->values            = map_new();
 	cg->identifier_to_rid = map_new();
 	cg->region_var_to_id  = map_new();
+	cg->fn_arities        = map_new();
+	cg->static_exprs      = map_new();
+	cg->dec_datas         = map_new();
+	cg->constructors      = map_new();
+	cg->owned_fields      = map_new();
+	cg->cafs              = list_new(arena);
+	cg->opt_level         = opt_level;
+	cg->gc_mode           = gc_mode;
+	cg->par_mode          = par_mode;
 	cg->rid_state         = 1; /* start at 1 as 0 == NULL */
 
 	if (cg->fptr == NULL) {
@@ -726,6 +3075,14 @@ void code_gen(struct prog *prog,
 		return;
 	}
 
+	map_put_str(cg->fn_arities, "add", (void *)2);
+	map_put_str(cg->fn_arities, "sub", (void *)2);
+	map_put_str(cg->fn_arities, "mul", (void *)2);
+	map_put_str(cg->fn_arities, "div", (void *)2);
+	map_put_str(cg->fn_arities, "par", (void *)2);
+	map_put_str(cg->fn_arities, "seq", (void *)2);
+	map_put_str(cg->fn_arities, "Cons", (void *)2);
+
 	code_gen_prog(cg, prog);
 	code_gen_values(cg);
 	code_gen_main(cg);
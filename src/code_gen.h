@@ -3,11 +3,28 @@
 
 #include "ast.h"
 #include "error.h"
+#include "simplify.h"
 #include <arena.h>
 
+/* how generated programs free memory */
+enum gc_mode {
+	GC_REGIONS, /* values are freed with the region they are in */
+	GC_COPYING  /* a tracing collector frees them once unreachable */
+};
+
+/* where generated programs spark values for other cores to evaluate */
+enum par_mode {
+	PAR_NONE,     /* nowhere, par only hints and all runs on one core */
+	PAR_EXPLICIT, /* only where par is called */
+	PAR_AUTO      /* also costly strict args evaluated alongside each other */
+};
+
 void code_gen(struct prog *prog,
               struct arena *arena,
               struct error_log *log,
-              char *file_name);
+              char *file_name,
+              enum opt_level opt_level,
+              enum gc_mode gc_mode,
+              enum par_mode par_mode);
 
 #endif
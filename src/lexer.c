@@ -178,6 +178,7 @@ struct token *scan_token(struct scanner *s, struct arena *arena) {
 	case ']': token->type = TOK_SQUARE_R; break;
 	case ',': token->type = TOK_COMMA; break;
 	case '@': token->type = TOK_AT; break;
+	case '!': token->type = TOK_BANG; break;
 	default:
 		if (isdigit(c)) {
 			scan_token_number(token, s);
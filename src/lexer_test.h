@@ -179,6 +179,8 @@ test scan_token_scans_comma(void) { SCAN_TOKEN_HELPER(TOK_COMMA, ","); }
 
 test scan_token_scans_at_symbol(void) { SCAN_TOKEN_HELPER(TOK_AT, "@"); }
 
+test scan_token_scans_bang(void) { SCAN_TOKEN_HELPER(TOK_BANG, "!"); }
+
 test scan_tokens_scans_a_sequence_of_tokens(void) {
 	struct token **tokens;
 	char *source          = "let x = 300 in\ny*x ==600";
@@ -289,5 +291,6 @@ void test_lexer_h(void) {
 	TEST(scan_token_scans_right_square_bracket);
 	TEST(scan_token_scans_comma);
 	TEST(scan_token_scans_at_symbol);
+	TEST(scan_token_scans_bang);
 	TEST(scan_tokens_scans_a_sequence_of_tokens);
 }
@@ -1,32 +1,71 @@
 #include "code_gen.h"
 #include "lexer.h"
 #include "parser.h"
+#include "partial_eval.h"
+#include "region.h"
+#include "simplify.h"
 #include "type_check.h"
 #include <arena.h>
 #include <stdio.h>
+#include <string.h>
 
 int main(int argc, char **argv) {
 	struct arena *arena = arena_alloc();
-	char source[1024];
+	char *source;
+	long source_len;
 	struct error_log *log;
 	struct token **tokens;
 	struct prog *prog;
 	FILE *fptr;
+	enum opt_level opt_level = OPT_NONE;
+	enum gc_mode gc_mode     = GC_REGIONS;
+	enum par_mode par_mode   = PAR_NONE;
+	char *source_path;
+	char *output_path;
+	int i;
 
-	if (argc != 3) {
+	for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+		if (strcmp(argv[i], "-O0") == 0) {
+			opt_level = OPT_NONE;
+		} else if (strcmp(argv[i], "-O1") == 0) {
+			opt_level = OPT_SIMPLE;
+		} else if (strcmp(argv[i], "-O2") == 0) {
+			opt_level = OPT_FULL;
+		} else if (strcmp(argv[i], "--gc=regions") == 0) {
+			gc_mode = GC_REGIONS;
+		} else if (strcmp(argv[i], "--gc=copying") == 0) {
+			gc_mode = GC_COPYING;
+		} else if (strcmp(argv[i], "--par") == 0) {
+			par_mode = PAR_EXPLICIT;
+		} else if (strcmp(argv[i], "--auto-par") == 0) {
+			par_mode = PAR_AUTO;
+		} else {
+			printf("Unknown option '%s' :(\n", argv[i]);
+			return 1;
+		}
+	}
+
+	if (argc - i != 2) {
 		return 1;
 	}
+	source_path = argv[i];
+	output_path = argv[i + 1];
 
-	printf("Compiling %s...\n", argv[1]);
+	printf("Compiling %s...\n", source_path);
 
-	fptr = fopen(argv[1], "r");
+	fptr = fopen(source_path, "r");
 
 	if (fptr == NULL) {
-		printf("Unable to read file '%s' :(\n", argv[1]);
+		printf("Unable to read file '%s' :(\n", source_path);
 		return 1;
 	}
 
-	fread(source, 1024, 1, fptr);
+	fseek(fptr, 0, SEEK_END);
+	source_len = ftell(fptr);
+	fseek(fptr, 0, SEEK_SET);
+	source = arena_push_array_zero(arena, source_len + 1, char);
+	fread(source, 1, source_len, fptr);
+	fclose(fptr);
 
 	log         = arena_push_struct_zero(arena, struct error_log);
 	log->source = source;
@@ -40,7 +79,10 @@ int main(int argc, char **argv) {
 	type_check(prog, arena, log);
 	if (log->had_error)
 		return 1;
-	code_gen(prog, arena, log, argv[2]);
+	simplify(prog, arena, opt_level);
+	partial_eval(prog, arena, opt_level);
+	infer_regions(prog, arena);
+	code_gen(prog, arena, log, output_path, opt_level, gc_mode, par_mode);
 	if (log->had_error)
 		return 1;
 	printf("Done :)\n");
@@ -39,6 +39,11 @@ static struct list *get_bucket(struct map *map, u64 hash) {
 	return map->buckets[index];
 }
 
+/* lookups create buckets, so a bucket can exist but be empty */
+static int bucket_is_empty(struct map *map, size_t index) {
+	return map->buckets[index] == NULL || list_head(map->buckets[index]) == NULL;
+}
+
 int find_in_bucket(struct list_iter *iter, u64 key_hash) {
 	while (!list_iter_at_end(iter)) {
 		struct map_list_elem *elem = list_iter_next(iter);
@@ -165,7 +170,7 @@ struct map_iter map_iterate(struct map *map) {
 
 	for (iter.index_next = 0; iter.index_next < (1 << iter.map->buckets_bit);
 	     iter.index_next++) {
-		if (iter.map->buckets[iter.index_next] != NULL) {
+		if (!bucket_is_empty(iter.map, iter.index_next)) {
 			break;
 		}
 	}
@@ -183,7 +188,7 @@ void *map_iter_next(struct map_iter *iter) {
 		iter->index_next++; /* increment so index_curr != index_next */
 		for (; iter->index_next < (1 << iter->map->buckets_bit);
 		     iter->index_next++) {
-			if (iter->map->buckets[iter->index_next] != NULL) {
+			if (!bucket_is_empty(iter->map, iter->index_next)) {
 				break;
 			}
 		}
@@ -618,8 +618,10 @@ static struct dec_type *parse_dec_type(struct parser *p) {
 	PARSE_IDENTIFIER(dec_type->name, "Expected declaration identifier");
 	CONSUME(TOK_COLON_COLON, "Expected '::' after identifier");
 	dec_type->type = parse_type(p);
-	CONSUME(TOK_TICK, "Missing ' after value type");
-	PARSE_IDENTIFIER(dec_type->region_var, "Expected region variable name");
+	/* regions are inferred where they aren't given */
+	if (match(p, TOK_TICK)) {
+		PARSE_IDENTIFIER(dec_type->region_var, "Expected region variable name");
+	}
 	CONSUME(TOK_SEMICOLON, "Expected ';' after type");
 	return dec_type;
 }
@@ -699,17 +701,20 @@ static struct def_instance *parse_def_instance(struct parser *p) {
 static struct dec_constructor *parse_dec_constructor(struct parser *p) {
 	struct dec_constructor *constructor =
 		arena_push_struct_zero(p->arena, struct dec_constructor);
-	constructor->type_params  = list_new(p->arena);
-	constructor->source_index = peek(p)->lexeme_index;
+	constructor->type_params   = list_new(p->arena);
+	constructor->strict_params = list_new(p->arena);
+	constructor->source_index  = peek(p)->lexeme_index;
 
 	PARSE_IDENTIFIER(constructor->name, "Expected constructor");
 
-	while (is_type_primary(peek_type(p))) {
+	while (peek_type(p) == TOK_BANG || is_type_primary(peek_type(p))) {
+		size_t is_strict      = match(p, TOK_BANG);
 		struct type *type_arg = parse_type_primary(p);
 		if (type_arg == NULL) {
 			return constructor;
 		}
 		list_append(constructor->type_params, type_arg);
+		list_append(constructor->strict_params, (void *)is_strict);
 	}
 
 	return constructor;
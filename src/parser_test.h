@@ -681,6 +681,17 @@ test parse_stmt_parses_type_declaration(void) {
 	PASS();
 }
 
+test parse_stmt_parses_type_declaration_without_region(void) {
+	struct parser p   = test_parser("myFunc :: Int -> Int;");
+	struct stmt *stmt = parse_stmt(&p);
+	EXPECT(p.log->had_error == 0);
+	EXPECT(stmt != NULL);
+	EXPECT(stmt->type == STMT_DEC_TYPE);
+	EXPECT(stmt->v.dec_type->region_var == NULL);
+	arena_free(p.arena);
+	PASS();
+}
+
 test parse_stmt_parses_basic_value_definitions(void) {
 	struct parser p         = test_parser("myFunc 0 = \"zero\";");
 	struct stmt *stmt       = parse_stmt(&p);
@@ -813,6 +824,34 @@ test parse_stmt_parses_generic_tree_data_dec(void) {
 	PASS();
 }
 
+test parse_stmt_parses_strict_constructor_params(void) {
+	struct parser p   = test_parser("data Tree {\n"
+	                                "  Node !Int Tree !Tree |\n"
+	                                "  Leaf\n"
+	                                "}");
+	struct stmt *stmt = parse_stmt(&p);
+	struct dec_constructor *constructor;
+	EXPECT(p.log->had_error == 0);
+	EXPECT(stmt != NULL);
+	EXPECT(stmt->type == STMT_DEC_DATA);
+
+	constructor = list_get(stmt->v.dec_data->dec_constructors, 0);
+	EXPECT(strcmp(constructor->name, "Node") == 0);
+	EXPECT(list_length(constructor->type_params) == 3);
+	EXPECT(list_length(constructor->strict_params) == 3);
+	EXPECT((size_t)list_get(constructor->strict_params, 0) == 1);
+	EXPECT((size_t)list_get(constructor->strict_params, 1) == 0);
+	EXPECT((size_t)list_get(constructor->strict_params, 2) == 1);
+	EXPECT(strcmp(((struct type *)list_get(constructor->type_params, 0))->name,
+	              "Int") == 0);
+
+	constructor = list_get(stmt->v.dec_data->dec_constructors, 1);
+	EXPECT(list_length(constructor->strict_params) == 0);
+
+	arena_free(p.arena);
+	PASS();
+}
+
 void test_parser_h(void) {
 	TEST(parse_expr_parses_identifiers);
 	TEST(parse_expr_parses_ints);
@@ -851,7 +890,9 @@ void test_parser_h(void) {
 	TEST(parse_stmt_parses_class_declarations);
 	TEST(parse_stmt_parses_data_declarations);
 	TEST(parse_stmt_parses_type_declaration);
+	TEST(parse_stmt_parses_type_declaration_without_region);
 	TEST(parse_stmt_parses_basic_value_definitions);
 	TEST(parse_stmt_parses_instance_definitions);
 	TEST(parse_stmt_parses_generic_tree_data_dec);
+	TEST(parse_stmt_parses_strict_constructor_params);
 }
@@ -0,0 +1,678 @@
+#include "partial_eval.h"
+#include "list.h"
+#include "map.h"
+#include <ctype.h>
+#include <string.h>
+
+/* evaluation steps and allocations allowed per top level value, for -O1 and
+ * -O2, how deep evaluation may nest on the compiler's own stack, and how many
+ * exprs a result may be built from */
+#define FUEL_SIMPLE   100000
+#define FUEL_FULL     1000000
+#define MEMORY_SIMPLE 100000
+#define MEMORY_FULL   1000000
+#define DEPTH_MAX     2000
+#define RESULT_MAX    4096
+
+struct pe_value;
+
+struct pe_env {
+	char *name;
+	struct pe_thunk *thunk;
+	struct pe_env *next;
+};
+
+struct pe_thunk {
+	struct expr *expr;
+	struct pe_env *env;
+	struct pe_value *value;
+	int is_evaluating;
+};
+
+enum pe_value_type { PE_INT, PE_CHAR, PE_BOOL, PE_DATA, PE_FN };
+
+struct pe_value {
+	enum pe_value_type type;
+
+	union {
+		int lit_int;
+		char lit_char;
+		int lit_bool;
+
+		struct {
+			char *constructor;
+			struct pe_thunk **fields;
+			size_t fields_len;
+		} data;
+
+		struct {
+			char *name;
+			size_t arity;
+			struct pe_thunk **args;
+			size_t args_len;
+		} fn;
+	} v;
+};
+
+struct partial_evaluator {
+	struct arena *arena;             /* holds the results */
+	struct arena *arena_eval;        /* freed after each top level value */
+	struct map *def_values;          /* char* -> list of struct def_value* */
+	struct map *constructor_types;   /* char* -> char* data type name */
+	struct map *constructor_arities; /* char* -> size_t */
+	struct map *types;               /* char* -> struct type* */
+	struct map *globals;             /* char* -> struct pe_thunk* */
+	size_t fuel_max;
+	size_t memory_max;
+	size_t fuel;
+	size_t memory;
+	size_t depth;
+	size_t result_size;
+	int failed;
+};
+
+/* ========== VALUES ========== */
+
+static void *pe_fail(struct partial_evaluator *pe) {
+	pe->failed = 1;
+	return NULL;
+}
+
+/* counts an allocation towards the memory limit */
+static int pe_charge(struct partial_evaluator *pe) {
+	if (pe->failed || pe->memory >= pe->memory_max) {
+		pe->failed = 1;
+		return 0;
+	}
+	pe->memory++;
+	return 1;
+}
+
+static struct pe_thunk **pe_thunks_new(struct partial_evaluator *pe,
+                                       size_t thunks_len) {
+	if (!pe_charge(pe)) {
+		return NULL;
+	}
+	return arena_push_array_zero(
+		pe->arena_eval, thunks_len + 1, struct pe_thunk *);
+}
+
+static struct pe_value *pe_value_new(struct partial_evaluator *pe,
+                                     enum pe_value_type type) {
+	struct pe_value *value;
+	if (!pe_charge(pe)) {
+		return NULL;
+	}
+	value       = arena_push_struct_zero(pe->arena_eval, struct pe_value);
+	value->type = type;
+	return value;
+}
+
+static struct pe_value *pe_data_new(struct partial_evaluator *pe,
+                                    char *constructor,
+                                    struct pe_thunk **fields,
+                                    size_t fields_len) {
+	struct pe_value *value = pe_value_new(pe, PE_DATA);
+	if (value != NULL) {
+		value->v.data.constructor = constructor;
+		value->v.data.fields      = fields;
+		value->v.data.fields_len  = fields_len;
+	}
+	return value;
+}
+
+static struct pe_value *pe_fn_new(struct partial_evaluator *pe,
+                                  char *name,
+                                  size_t arity,
+                                  struct pe_thunk **args,
+                                  size_t args_len) {
+	struct pe_value *value = pe_value_new(pe, PE_FN);
+	if (value != NULL) {
+		value->v.fn.name     = name;
+		value->v.fn.arity    = arity;
+		value->v.fn.args     = args;
+		value->v.fn.args_len = args_len;
+	}
+	return value;
+}
+
+static struct pe_thunk *pe_env_lookup(struct pe_env *env, char *name) {
+	for (; env != NULL; env = env->next) {
+		if (strcmp(env->name, name) == 0) {
+			return env->thunk;
+		}
+	}
+	return NULL;
+}
+
+static struct pe_env *pe_env_bind(struct partial_evaluator *pe,
+                                  struct pe_env *env,
+                                  char *name,
+                                  struct pe_thunk *thunk) {
+	struct pe_env *binding;
+	if (!pe_charge(pe)) {
+		return NULL;
+	}
+	binding        = arena_push_struct_zero(pe->arena_eval, struct pe_env);
+	binding->name  = name;
+	binding->thunk = thunk;
+	binding->next  = env;
+	return binding;
+}
+
+static struct pe_thunk *pe_thunk_new(struct partial_evaluator *pe,
+                                     struct expr *expr,
+                                     struct pe_env *env) {
+	struct pe_thunk *thunk;
+
+	/* variables share the thunk they are bound to */
+	if (expr->expr_type == EXPR_IDENTIFIER) {
+		thunk = pe_env_lookup(env, expr->v.identifier);
+		if (thunk != NULL) {
+			return thunk;
+		}
+	}
+
+	if (!pe_charge(pe)) {
+		return NULL;
+	}
+	thunk       = arena_push_struct_zero(pe->arena_eval, struct pe_thunk);
+	thunk->expr = expr;
+	thunk->env  = env;
+	return thunk;
+}
+
+/* ========== EVALUATION ========== */
+
+static struct pe_value *
+pe_eval(struct partial_evaluator *pe, struct expr *expr, struct pe_env *env);
+
+static struct pe_value *pe_force(struct partial_evaluator *pe,
+                                 struct pe_thunk *thunk) {
+	if (thunk->value != NULL) {
+		return thunk->value;
+	}
+	if (thunk->is_evaluating) {
+		/* left for the runtime to report the loop */
+		return pe_fail(pe);
+	}
+	thunk->is_evaluating = 1;
+	thunk->value         = pe_eval(pe, thunk->expr, thunk->env);
+	thunk->is_evaluating = 0;
+	return thunk->value;
+}
+
+static int is_builtin(char *name) {
+	return strcmp(name, "+") == 0 || strcmp(name, "-") == 0 ||
+	       strcmp(name, "*") == 0 || strcmp(name, "/") == 0;
+}
+
+static int is_constructor_name(char *name) {
+	return isupper(name[0]) || strcmp(name, ":") == 0 || strcmp(name, "[]") == 0;
+}
+
+static struct pe_value *pe_eval_name(struct partial_evaluator *pe,
+                                     char *name,
+                                     struct pe_env *env) {
+	struct pe_thunk *thunk = pe_env_lookup(env, name);
+	struct list *def_values;
+	struct def_value *def_value;
+	size_t arity;
+
+	if (thunk != NULL) {
+		return pe_force(pe, thunk);
+	}
+	if (is_builtin(name)) {
+		return pe_fn_new(pe, name, 2, NULL, 0);
+	}
+	if (is_constructor_name(name)) {
+		arity = (size_t)map_get_str(pe->constructor_arities, name);
+		return arity == 0 ? pe_data_new(pe, name, NULL, 0)
+		                  : pe_fn_new(pe, name, arity, NULL, 0);
+	}
+
+	def_values = map_get_str(pe->def_values, name);
+	if (def_values == NULL) {
+		return pe_fail(pe);
+	}
+	def_value = list_head(def_values);
+	arity     = list_length(def_value->expr_params);
+	if (arity > 0) {
+		return pe_fn_new(pe, name, arity, NULL, 0);
+	}
+
+	/* top level values are shared, as their static thunks are at runtime */
+	thunk = map_get_str(pe->globals, name);
+	if (thunk == NULL) {
+		thunk = pe_thunk_new(pe, def_value->value, NULL);
+		if (thunk == NULL) {
+			return NULL;
+		}
+		map_put_str(pe->globals, name, thunk);
+	}
+	return pe_force(pe, thunk);
+}
+
+static struct pe_value *pe_call_builtin(struct partial_evaluator *pe,
+                                        char *name,
+                                        struct pe_thunk **args) {
+	struct pe_value *lhs = pe_force(pe, args[0]);
+	struct pe_value *rhs = lhs == NULL ? NULL : pe_force(pe, args[1]);
+	struct pe_value *value;
+	unsigned int x, y;
+
+	if (rhs == NULL) {
+		return NULL;
+	}
+	if (lhs->type != PE_INT || rhs->type != PE_INT) {
+		return pe_fail(pe);
+	}
+
+	/* wraps on overflow, like the runtime's ints in practice */
+	x = lhs->v.lit_int;
+	y = rhs->v.lit_int;
+	value = pe_value_new(pe, PE_INT);
+	if (value == NULL) {
+		return NULL;
+	}
+	switch (name[0]) {
+	case '+': value->v.lit_int = (int)(x + y); break;
+	case '-': value->v.lit_int = (int)(x - y); break;
+	case '*': value->v.lit_int = (int)(x * y); break;
+	case '/':
+		if (rhs->v.lit_int == 0 ||
+		    (rhs->v.lit_int == -1 && lhs->v.lit_int < -0x7fffffff)) {
+			return pe_fail(pe);
+		}
+		value->v.lit_int = lhs->v.lit_int / rhs->v.lit_int;
+		break;
+	}
+	return value;
+}
+
+static char *pattern_constructor(struct expr *pattern) {
+	switch (pattern->expr_type) {
+	case EXPR_LIST_NULL: return "[]";
+	case EXPR_IDENTIFIER: return pattern->v.identifier;
+	case EXPR_APPLICATION: return pattern->v.application.fn;
+	default: return NULL;
+	}
+}
+
+/* 1 if the pattern matches, binding its variables in env, 0 if it doesn't
+ * and -1 if evaluation failed */
+static int pe_match(struct partial_evaluator *pe,
+                    struct expr *pattern,
+                    struct pe_thunk *thunk,
+                    struct pe_env **env) {
+	struct pe_value *value;
+	size_t i;
+
+	switch (pattern->expr_type) {
+	case EXPR_GROUPING: return pe_match(pe, pattern->v.grouping, thunk, env);
+	case EXPR_IDENTIFIER:
+		if (!is_constructor_name(pattern->v.identifier)) {
+			if (pattern->v.identifier[0] != '_') {
+				*env = pe_env_bind(pe, *env, pattern->v.identifier, thunk);
+				if (*env == NULL) {
+					return -1;
+				}
+			}
+			return 1;
+		}
+		/* fall through */
+	case EXPR_LIST_NULL:
+	case EXPR_APPLICATION:
+		value = pe_force(pe, thunk);
+		if (value == NULL || value->type != PE_DATA) {
+			pe->failed = 1;
+			return -1;
+		}
+		if (strcmp(pattern_constructor(pattern), value->v.data.constructor) != 0) {
+			return 0;
+		}
+		if (pattern->expr_type != EXPR_APPLICATION) {
+			return 1;
+		}
+		i = 0;
+		list_for_each(pattern->v.application.expr_args,
+		              struct expr *,
+		              int match = pe_match(pe, _value, value->v.data.fields[i++], env);
+		              if (match != 1) return match;);
+		return 1;
+	case EXPR_LIT_INT:
+		value = pe_force(pe, thunk);
+		if (value == NULL) {
+			return -1;
+		}
+		return value->v.lit_int == pattern->v.lit_int;
+	case EXPR_LIT_CHAR:
+		value = pe_force(pe, thunk);
+		if (value == NULL) {
+			return -1;
+		}
+		return value->v.lit_char == pattern->v.lit_char;
+	case EXPR_LIT_BOOL:
+		value = pe_force(pe, thunk);
+		if (value == NULL) {
+			return -1;
+		}
+		return value->v.lit_bool == pattern->v.lit_bool;
+	default: pe->failed = 1; return -1;
+	}
+}
+
+/* calls a saturated function, trying its clauses in order */
+static struct pe_value *pe_call(struct partial_evaluator *pe,
+                                char *name,
+                                struct pe_thunk **args,
+                                size_t args_len) {
+	struct list *def_values;
+	struct list_iter def_values_iter;
+
+	if (is_builtin(name)) {
+		return pe_call_builtin(pe, name, args);
+	}
+	if (is_constructor_name(name)) {
+		return pe_data_new(pe, name, args, args_len);
+	}
+
+	def_values      = map_get_str(pe->def_values, name);
+	def_values_iter = list_iterate(def_values);
+	while (!list_iter_at_end(&def_values_iter)) {
+		struct def_value *def_value  = list_iter_next(&def_values_iter);
+		struct list_iter params_iter = list_iterate(def_value->expr_params);
+		struct pe_env *env           = NULL;
+		int match                    = 1;
+		size_t i                     = 0;
+
+		while (match == 1 && !list_iter_at_end(&params_iter)) {
+			match = pe_match(pe, list_iter_next(&params_iter), args[i++], &env);
+		}
+		if (match == -1) {
+			return NULL;
+		}
+		if (match == 1) {
+			return pe_eval(pe, def_value->value, env);
+		}
+	}
+
+	/* left for the runtime to report the unmatched pattern */
+	return pe_fail(pe);
+}
+
+static struct pe_value *pe_apply(struct partial_evaluator *pe,
+                                 struct pe_value *fn,
+                                 struct pe_thunk **args,
+                                 size_t args_len) {
+	size_t args_len_all = fn->v.fn.args_len + args_len;
+	struct pe_thunk **args_all = pe_thunks_new(pe, args_len_all);
+	struct pe_value *result;
+
+	if (args_all == NULL) {
+		return NULL;
+	}
+	memcpy(args_all, fn->v.fn.args, fn->v.fn.args_len * sizeof(struct pe_thunk *));
+	memcpy(args_all + fn->v.fn.args_len, args, args_len * sizeof(struct pe_thunk *));
+
+	if (args_len_all < fn->v.fn.arity) {
+		return pe_fn_new(pe, fn->v.fn.name, fn->v.fn.arity, args_all, args_len_all);
+	}
+
+	result = pe_call(pe, fn->v.fn.name, args_all, fn->v.fn.arity);
+	if (result == NULL || args_len_all == fn->v.fn.arity) {
+		return result;
+	}
+	if (result->type != PE_FN) {
+		return pe_fail(pe);
+	}
+	return pe_apply(pe,
+	                result,
+	                args_all + fn->v.fn.arity,
+	                args_len_all - fn->v.fn.arity);
+}
+
+static struct pe_value *pe_eval_expr(struct partial_evaluator *pe,
+                                     struct expr *expr,
+                                     struct pe_env *env) {
+	struct pe_value *value;
+
+	switch (expr->expr_type) {
+	case EXPR_LIT_INT:
+		value = pe_value_new(pe, PE_INT);
+		if (value != NULL) {
+			value->v.lit_int = expr->v.lit_int;
+		}
+		return value;
+	case EXPR_LIT_CHAR:
+		value = pe_value_new(pe, PE_CHAR);
+		if (value != NULL) {
+			value->v.lit_char = expr->v.lit_char;
+		}
+		return value;
+	case EXPR_LIT_BOOL:
+		value = pe_value_new(pe, PE_BOOL);
+		if (value != NULL) {
+			value->v.lit_bool = expr->v.lit_bool;
+		}
+		return value;
+	case EXPR_LIST_NULL: return pe_data_new(pe, "[]", NULL, 0);
+	case EXPR_IDENTIFIER: return pe_eval_name(pe, expr->v.identifier, env);
+	case EXPR_GROUPING: return pe_eval(pe, expr->v.grouping, env);
+	case EXPR_APPLICATION: {
+		size_t args_len = list_length(expr->v.application.expr_args);
+		struct pe_value *fn = pe_eval_name(pe, expr->v.application.fn, env);
+		struct pe_thunk **args;
+		size_t i = 0;
+
+		if (fn == NULL) {
+			return NULL;
+		}
+		if (fn->type != PE_FN) {
+			return pe_fail(pe);
+		}
+		args = pe_thunks_new(pe, args_len);
+		if (args == NULL) {
+			return NULL;
+		}
+		list_for_each(expr->v.application.expr_args,
+		              struct expr *,
+		              args[i++] = pe_thunk_new(pe, _value, env));
+		if (pe->failed) {
+			return NULL;
+		}
+		return pe_apply(pe, fn, args, args_len);
+	}
+	default: return pe_fail(pe); /* doubles, strings and let..in */
+	}
+}
+
+static struct pe_value *
+pe_eval(struct partial_evaluator *pe, struct expr *expr, struct pe_env *env) {
+	struct pe_value *value;
+
+	if (pe->failed || pe->fuel == 0 || pe->depth == DEPTH_MAX) {
+		return pe_fail(pe);
+	}
+	pe->fuel--;
+	pe->depth++;
+	value = pe_eval_expr(pe, expr, env);
+	pe->depth--;
+	return value;
+}
+
+/* ========== RESULTS ========== */
+
+static struct type *pe_type(struct partial_evaluator *pe, char *name) {
+	struct type *type = map_get_str(pe->types, name);
+	if (type == NULL) {
+		type       = arena_push_struct_zero(pe->arena, struct type);
+		type->name = name;
+		map_put_str(pe->types, name, type);
+	}
+	return type;
+}
+
+/* evaluates a thunk completely, into an expr code_gen can emit as static
+ * data. NULL if it doesn't finish or isn't data */
+static struct expr *pe_quote(struct partial_evaluator *pe,
+                             struct pe_thunk *thunk) {
+	struct pe_value *value = pe_force(pe, thunk);
+	struct expr *expr;
+	size_t i;
+
+	if (value == NULL || pe->result_size++ == RESULT_MAX ||
+	    pe->depth == DEPTH_MAX) {
+		return pe_fail(pe);
+	}
+
+	expr = arena_push_struct_zero(pe->arena, struct expr);
+	switch (value->type) {
+	case PE_INT:
+		expr->expr_type = EXPR_LIT_INT;
+		expr->v.lit_int = value->v.lit_int;
+		expr->type      = pe_type(pe, "Int");
+		break;
+	case PE_CHAR:
+		expr->expr_type  = EXPR_LIT_CHAR;
+		expr->v.lit_char = value->v.lit_char;
+		expr->type       = pe_type(pe, "Char");
+		break;
+	case PE_BOOL:
+		expr->expr_type  = EXPR_LIT_BOOL;
+		expr->v.lit_bool = value->v.lit_bool;
+		expr->type       = pe_type(pe, "Bool");
+		break;
+	case PE_DATA:
+		expr->type = pe_type(
+			pe, map_get_str(pe->constructor_types, value->v.data.constructor));
+		if (strcmp(value->v.data.constructor, "[]") == 0) {
+			expr->expr_type = EXPR_LIST_NULL;
+		} else if (value->v.data.fields_len == 0) {
+			expr->expr_type    = EXPR_IDENTIFIER;
+			expr->v.identifier = value->v.data.constructor;
+		} else {
+			expr->expr_type                = EXPR_APPLICATION;
+			expr->v.application.fn        = value->v.data.constructor;
+			expr->v.application.expr_args = list_new(pe->arena);
+			pe->depth++;
+			for (i = 0; i < value->v.data.fields_len; i++) {
+				struct expr *field = pe_quote(pe, value->v.data.fields[i]);
+				if (field == NULL) {
+					return NULL;
+				}
+				list_append(expr->v.application.expr_args, field);
+			}
+			pe->depth--;
+		}
+		break;
+	case PE_FN: return pe_fail(pe);
+	}
+	return expr;
+}
+
+/* ========== PROGRAM ========== */
+
+/* top level values which could become static data */
+static int is_evaluable(struct def_value *def_value) {
+	if (list_length(def_value->expr_params) != 0 ||
+	    strcmp(def_value->value->type->name, "->") == 0) {
+		return 0;
+	}
+	switch (def_value->value->expr_type) {
+	case EXPR_LIT_INT:
+	case EXPR_LIT_CHAR:
+	case EXPR_LIT_BOOL:
+	case EXPR_LIST_NULL: return 0;
+	default: return 1;
+	}
+}
+
+static void partial_eval_def_value(struct partial_evaluator *pe,
+                                   struct def_value *def_value) {
+	struct pe_thunk *thunk;
+	struct expr *value = NULL;
+
+	pe->arena_eval  = arena_alloc();
+	pe->globals     = map_new();
+	pe->fuel        = pe->fuel_max;
+	pe->memory      = 0;
+	pe->depth       = 0;
+	pe->result_size = 0;
+	pe->failed      = 0;
+
+	thunk = pe_thunk_new(pe, def_value->value, NULL);
+	if (thunk != NULL) {
+		map_put_str(pe->globals, def_value->name, thunk);
+		value = pe_quote(pe, thunk);
+	}
+	if (value != NULL) {
+		def_value->value = value;
+	}
+
+	map_free(pe->globals);
+	arena_free(pe->arena_eval);
+}
+
+static void add_def_value(struct partial_evaluator *pe,
+                          struct def_value *def_value) {
+	struct list *def_values = map_get_str(pe->def_values, def_value->name);
+	if (def_values == NULL) {
+		def_values = list_new(pe->arena);
+		map_put_str(pe->def_values, def_value->name, def_values);
+	}
+	list_append(def_values, def_value);
+}
+
+static void add_dec_data(struct partial_evaluator *pe,
+                         struct dec_data *dec_data) {
+	list_for_each(
+		dec_data->dec_constructors, struct dec_constructor *,
+		map_put_str(pe->constructor_types, _value->name, dec_data->name);
+		map_put_str(pe->constructor_arities,
+	              _value->name,
+	              (void *)(_value->type_params == NULL
+	                         ? 0
+	                         : list_length(_value->type_params))));
+}
+
+void partial_eval(struct prog *prog,
+                  struct arena *arena,
+                  enum opt_level level) {
+	struct partial_evaluator *pe;
+
+	if (level == OPT_NONE) {
+		return;
+	}
+
+	pe = arena_push_struct_zero(arena, struct partial_evaluator);
+	pe->arena               = arena;
+	pe->def_values          = map_new();
+	pe->constructor_types   = map_new();
+	pe->constructor_arities = map_new();
+	pe->types               = map_new();
+	pe->fuel_max   = level == OPT_FULL ? FUEL_FULL : FUEL_SIMPLE;
+	pe->memory_max = level == OPT_FULL ? MEMORY_FULL : MEMORY_SIMPLE;
+
+	map_put_str(pe->constructor_types, ":", "[]");
+	map_put_str(pe->constructor_types, "[]", "[]");
+	map_put_str(pe->constructor_arities, ":", (void *)2);
+
+	list_for_each(
+		prog->stmts, struct stmt *, switch (_value->type) {
+			case STMT_DEF_VALUE: add_def_value(pe, _value->v.def_value); break;
+			case STMT_DEC_DATA: add_dec_data(pe, _value->v.dec_data); break;
+			default: break;
+		});
+
+	list_for_each(prog->stmts,
+	              struct stmt *,
+	              if (_value->type == STMT_DEF_VALUE &&
+	                  is_evaluable(_value->v.def_value))
+		              partial_eval_def_value(pe, _value->v.def_value));
+
+	map_free(pe->def_values);
+	map_free(pe->constructor_types);
+	map_free(pe->constructor_arities);
+	map_free(pe->types);
+}
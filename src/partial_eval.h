@@ -0,0 +1,13 @@
+#ifndef RACC_PARTIAL_EVAL_H
+#define RACC_PARTIAL_EVAL_H
+
+#include "ast.h"
+#include "simplify.h"
+#include <arena.h>
+
+/* evaluates top level values at compile time, within fuel and memory limits,
+ * replacing those which finish with literals or constructors which code_gen
+ * emits as static data */
+void partial_eval(struct prog *prog, struct arena *arena, enum opt_level level);
+
+#endif
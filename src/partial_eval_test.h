@@ -0,0 +1,105 @@
+#include "arena.h"
+#include "ast.h"
+#include "lexer.h"
+#include "list.h"
+#include "parser.h"
+#include "partial_eval.h"
+#include "simplify.h"
+#include "type_check.h"
+#include <ctest.h>
+#include <string.h>
+
+/* evaluates the source, then checks condition against the value of main */
+#define PARTIAL_EVAL_TEST(_name, _source, _condition)                          \
+	test _name(void) {                                                           \
+		struct arena *arena = arena_alloc();                                       \
+		char *source        = _source;                                             \
+		struct error_log *log;                                                     \
+		struct token **tokens;                                                     \
+		struct prog *prog;                                                         \
+		struct list_iter stmts_iter;                                               \
+		struct expr *expr;                                                         \
+		log         = arena_push_struct_zero(arena, struct error_log);             \
+		log->source = source;                                                      \
+		tokens      = scan_tokens(source, arena, log);                             \
+		assert(log->had_error == 0);                                               \
+		prog = parse(tokens, arena, log);                                          \
+		assert(log->had_error == 0);                                               \
+		type_check(prog, arena, log);                                              \
+		assert(log->had_error == 0);                                               \
+		simplify(prog, arena, OPT_SIMPLE);                                         \
+		partial_eval(prog, arena, OPT_SIMPLE);                                     \
+		stmts_iter = list_iterate(prog->stmts);                                    \
+		expr       = NULL;                                                         \
+		while (!list_iter_at_end(&stmts_iter)) {                                   \
+			struct stmt *stmt = list_iter_next(&stmts_iter);                         \
+			if (stmt->type == STMT_DEF_VALUE &&                                      \
+			    strcmp(stmt->v.def_value->name, "main") == 0) {                      \
+				expr = stmt->v.def_value->value;                                       \
+			}                                                                        \
+		}                                                                          \
+		EXPECT(expr != NULL);                                                      \
+		EXPECT(_condition);                                                        \
+		arena_free(arena);                                                         \
+		PASS();                                                                    \
+	}
+
+PARTIAL_EVAL_TEST(partial_eval_evaluates_arithmetic,
+                  "main :: Int 'r;\n"
+                  "main = 1 + 2 - 4;\n",
+                  expr->expr_type == EXPR_LIT_INT && expr->v.lit_int == -1)
+
+PARTIAL_EVAL_TEST(partial_eval_evaluates_lazy_lists,
+                  "ones :: [Int] 'r;\n"
+                  "ones = 1 : ones;\n"
+                  "take :: Int -> [Int] -> [Int] 'r;\n"
+                  "take 0 _ = [];\n"
+                  "take n (x:xs) = x : take (n - 1) xs;\n"
+                  "sum :: [Int] -> Int 'r;\n"
+                  "sum [] = 0;\n"
+                  "sum (x:xs) = x + sum xs;\n"
+                  "main :: Int 'r;\n"
+                  "main = sum (take 5 ones);\n",
+                  expr->expr_type == EXPR_LIT_INT && expr->v.lit_int == 5)
+
+PARTIAL_EVAL_TEST(partial_eval_builds_data,
+                  "data Tree a { Node a (Tree a) (Tree a) | Leaf }\n"
+                  "single :: Int -> Tree Int 'r;\n"
+                  "single x = Node x Leaf Leaf;\n"
+                  "main :: Tree Int 'r;\n"
+                  "main = single (1 + 1);\n",
+                  expr->expr_type == EXPR_APPLICATION &&
+                    strcmp(expr->v.application.fn, "Node") == 0 &&
+                    strcmp(expr->type->name, "Tree") == 0)
+
+PARTIAL_EVAL_TEST(partial_eval_leaves_infinite_data,
+                  "main :: [Int] 'r;\n"
+                  "main = 1 : main;\n",
+                  expr->expr_type == EXPR_APPLICATION &&
+                    expr->v.application.expr_args != NULL &&
+                    ((struct expr *)list_last(expr->v.application.expr_args))
+                        ->expr_type == EXPR_IDENTIFIER)
+
+PARTIAL_EVAL_TEST(partial_eval_leaves_loops,
+                  "main :: Int 'r;\n"
+                  "main = main + 1;\n",
+                  expr->expr_type == EXPR_APPLICATION)
+
+PARTIAL_EVAL_TEST(partial_eval_leaves_unmatched_patterns,
+                  "data Maybe a { Nothing | Just a }\n"
+                  "fromJust :: Maybe Int -> Int 'r;\n"
+                  "fromJust (Just x) = x;\n"
+                  "nothing :: Maybe Int 'r;\n"
+                  "nothing = Nothing;\n"
+                  "main :: Int 'r;\n"
+                  "main = fromJust nothing;\n",
+                  expr->expr_type == EXPR_APPLICATION)
+
+void test_partial_eval_h(void) {
+	TEST(partial_eval_evaluates_arithmetic);
+	TEST(partial_eval_evaluates_lazy_lists);
+	TEST(partial_eval_builds_data);
+	TEST(partial_eval_leaves_infinite_data);
+	TEST(partial_eval_leaves_loops);
+	TEST(partial_eval_leaves_unmatched_patterns);
+}
@@ -0,0 +1,319 @@
+#include "region.h"
+#include "list.h"
+#include "map.h"
+#include "set.h"
+#include <ctype.h>
+#include <string.h>
+
+struct region_inferrer {
+	struct arena *arena;
+	struct map *dec_types;  /* char* -> struct dec_type*, every value */
+	struct map *refs;       /* char* -> list of char*, the names it refers to */
+	struct map *tail_refs;  /* char* -> list of char*, those it tail calls */
+	struct map *clauses;    /* char* -> list of lists of refs, one per clause */
+	struct set *enum_datas; /* char*, data types with only nullary constructors */
+	struct list *names;     /* char*, every value */
+};
+
+static struct list *refs_in(struct region_inferrer *ri,
+                            struct map *refs_map,
+                            char *name) {
+	struct list *refs = map_get_str(refs_map, name);
+	if (refs == NULL) {
+		refs = list_new(ri->arena);
+		map_put_str(refs_map, name, refs);
+	}
+	return refs;
+}
+
+/* the function expr calls in tail position, if any */
+static char *tail_ref(struct expr *expr) {
+	switch (expr->expr_type) {
+	case EXPR_APPLICATION: return expr->v.application.fn;
+	case EXPR_GROUPING: return tail_ref(expr->v.grouping);
+	case EXPR_LET_IN: return tail_ref(expr->v.let_in.value);
+	default: return NULL;
+	}
+}
+
+static void collect_pattern_vars(struct expr *pattern, struct set *vars) {
+	switch (pattern->expr_type) {
+	case EXPR_IDENTIFIER:
+		if (islower(pattern->v.identifier[0])) {
+			set_put_str(vars, pattern->v.identifier);
+		}
+		break;
+	case EXPR_APPLICATION:
+		list_for_each(pattern->v.application.expr_args,
+		              struct expr *,
+		              collect_pattern_vars(_value, vars));
+		break;
+	case EXPR_GROUPING: collect_pattern_vars(pattern->v.grouping, vars); break;
+	default: break;
+	}
+}
+
+static void infer_stmts(struct region_inferrer *ri,
+                        struct list *stmts,
+                        char *region_var);
+
+/* adds the names expr refers to, other than locals, to refs */
+static void add_refs(struct region_inferrer *ri,
+                     struct list *refs,
+                     struct expr *expr,
+                     struct set *locals,
+                     char *region_var) {
+	switch (expr->expr_type) {
+	case EXPR_IDENTIFIER:
+		if (!set_has_str(locals, expr->v.identifier)) {
+			list_append(refs, expr->v.identifier);
+		}
+		break;
+	case EXPR_APPLICATION:
+		if (!set_has_str(locals, expr->v.application.fn)) {
+			list_append(refs, expr->v.application.fn);
+		}
+		list_for_each(expr->v.application.expr_args,
+		              struct expr *,
+		              add_refs(ri, refs, _value, locals, region_var));
+		break;
+	case EXPR_GROUPING:
+		add_refs(ri, refs, expr->v.grouping, locals, region_var);
+		break;
+	case EXPR_LET_IN:
+		infer_stmts(ri, expr->v.let_in.stmts, region_var);
+		add_refs(ri, refs, expr->v.let_in.value, locals, region_var);
+		break;
+	default: break;
+	}
+}
+
+static void infer_def_value(struct region_inferrer *ri,
+                            struct def_value *def_value) {
+	struct dec_type *dec_type = map_get_str(ri->dec_types, def_value->name);
+	struct set *locals        = set_new();
+	char *tail_fn             = tail_ref(def_value->value);
+	struct list *refs         = list_new(ri->arena);
+	list_for_each(def_value->expr_params,
+	              struct expr *,
+	              collect_pattern_vars(_value, locals));
+	if (tail_fn != NULL && !set_has_str(locals, tail_fn)) {
+		list_append(refs_in(ri, ri->tail_refs, def_value->name), tail_fn);
+	}
+	add_refs(ri,
+	         refs,
+	         def_value->value,
+	         locals,
+	         dec_type == NULL ? def_value->name : dec_type->region_var);
+	list_prepend_all(refs_in(ri, ri->refs, def_value->name), refs);
+	list_append(refs_in(ri, ri->clauses, def_value->name), refs);
+	set_free(locals);
+}
+
+static void infer_dec_data(struct region_inferrer *ri,
+                           struct dec_data *dec_data) {
+	struct list_iter iter = list_iterate(dec_data->dec_constructors);
+	while (!list_iter_at_end(&iter)) {
+		struct dec_constructor *dec_constructor = list_iter_next(&iter);
+		if (list_length(dec_constructor->type_params) > 0) {
+			return;
+		}
+	}
+	set_put_str(ri->enum_datas, dec_data->name);
+}
+
+/* region_var is that of the value stmts are let bound in, NULL at the top */
+static void infer_stmts(struct region_inferrer *ri,
+                        struct list *stmts,
+                        char *region_var) {
+	struct list_iter iter = list_iterate(stmts);
+	while (!list_iter_at_end(&iter)) {
+		struct stmt *stmt = list_iter_next(&iter);
+		switch (stmt->type) {
+		case STMT_DEC_TYPE: {
+			struct dec_type *dec_type = stmt->v.dec_type;
+			if (dec_type->region_var == NULL) {
+				dec_type->region_var =
+					region_var == NULL ? dec_type->name : region_var;
+			}
+			map_put_str(ri->dec_types, dec_type->name, dec_type);
+			list_append(ri->names, dec_type->name);
+			break;
+		}
+		case STMT_DEF_VALUE: infer_def_value(ri, stmt->v.def_value); break;
+		case STMT_DEC_DATA: infer_dec_data(ri, stmt->v.dec_data); break;
+		default: break;
+		}
+	}
+}
+
+/* whether target is among the values from refers to, directly or not */
+static int reaches(struct region_inferrer *ri,
+                   char *from,
+                   char *target,
+                   struct set *visited) {
+	struct list *refs = map_get_str(ri->refs, from);
+	struct list_iter iter;
+	if (refs == NULL) {
+		return 0;
+	}
+	iter = list_iterate(refs);
+	while (!list_iter_at_end(&iter)) {
+		char *ref = list_iter_next(&iter);
+		if (strcmp(ref, target) == 0) {
+			return 1;
+		}
+		if (!set_has_str(visited, ref) &&
+		    map_get_str(ri->dec_types, ref) != NULL) {
+			set_put_str(visited, ref);
+			if (reaches(ri, ref, target, visited)) {
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+static int is_recursive(struct region_inferrer *ri, char *name) {
+	struct set *visited = set_new();
+	int is_recursive    = reaches(ri, name, name, visited);
+	set_free(visited);
+	return is_recursive;
+}
+
+/* whether some value name refers to, directly or not, is recursive */
+static int calls_recursion(struct region_inferrer *ri, char *name) {
+	struct list_iter iter = list_iterate(ri->names);
+	while (!list_iter_at_end(&iter)) {
+		char *callee        = list_iter_next(&iter);
+		struct set *visited = set_new();
+		int is_reached      = reaches(ri, name, callee, visited);
+		set_free(visited);
+		if (is_reached && is_recursive(ri, callee)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* whether some clause of name calls back into its recursion more than once,
+ * so its calls run one after another rather than all being live at once */
+static int is_tree_recursive(struct region_inferrer *ri, char *name) {
+	struct list *clauses = map_get_str(ri->clauses, name);
+	struct list_iter clauses_iter;
+	if (clauses == NULL) {
+		return 0;
+	}
+	clauses_iter = list_iterate(clauses);
+	while (!list_iter_at_end(&clauses_iter)) {
+		struct list_iter refs_iter = list_iterate(list_iter_next(&clauses_iter));
+		size_t recursive_calls     = 0;
+		while (!list_iter_at_end(&refs_iter)) {
+			char *ref           = list_iter_next(&refs_iter);
+			struct set *visited = set_new();
+			if (strcmp(ref, name) == 0 ||
+			    (map_get_str(ri->dec_types, ref) != NULL &&
+			     reaches(ri, ref, name, visited))) {
+				recursive_calls++;
+			}
+			set_free(visited);
+		}
+		if (recursive_calls > 1) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* whether name tail calls a value other than itself, which the trampoline
+ * runs after it returns so mutual recursion runs in constant stack */
+static int tail_calls_other(struct region_inferrer *ri, char *name) {
+	struct list *tail_refs = map_get_str(ri->tail_refs, name);
+	struct list_iter iter;
+	if (tail_refs == NULL) {
+		return 0;
+	}
+	iter = list_iterate(tail_refs);
+	while (!list_iter_at_end(&iter)) {
+		char *tail_fn = list_iter_next(&iter);
+		if (strcmp(tail_fn, name) != 0 &&
+		    map_get_str(ri->dec_types, tail_fn) != NULL) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* values which are held in a register, so can't point into a region */
+static int is_immediate_type(struct region_inferrer *ri, struct type *type) {
+	return strcmp(type->name, "Int") == 0 || strcmp(type->name, "Char") == 0 ||
+	       strcmp(type->name, "Bool") == 0 ||
+	       set_has_str(ri->enum_datas, type->name);
+}
+
+static int is_immediate_result(struct region_inferrer *ri, struct type *type) {
+	while (strcmp(type->name, "->") == 0) {
+		type = list_last(type->type_args);
+	}
+	return is_immediate_type(ri, type);
+}
+
+static int has_immediate_params(struct region_inferrer *ri, struct type *type) {
+	while (strcmp(type->name, "->") == 0) {
+		if (!is_immediate_type(ri, list_head(type->type_args))) {
+			return 0;
+		}
+		type = list_last(type->type_args);
+	}
+	return 1;
+}
+
+/* whether name tail calls itself, looping rather than recursing */
+static int tail_calls_self(struct region_inferrer *ri, char *name) {
+	struct list *tail_refs = map_get_str(ri->tail_refs, name);
+	struct list_iter iter;
+	if (tail_refs == NULL) {
+		return 0;
+	}
+	iter = list_iterate(tail_refs);
+	while (!list_iter_at_end(&iter)) {
+		if (strcmp(list_iter_next(&iter), name) == 0) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+void infer_regions(struct prog *prog, struct arena *arena) {
+	struct region_inferrer ri;
+	struct list_iter iter;
+
+	ri.arena      = arena;
+	ri.dec_types  = map_new();
+	ri.refs       = map_new();
+	ri.tail_refs  = map_new();
+	ri.clauses    = map_new();
+	ri.enum_datas = set_new();
+	ri.names      = list_new(arena);
+
+	infer_stmts(&ri, prog->stmts, NULL);
+
+	iter = list_iterate(ri.names);
+	while (!list_iter_at_end(&iter)) {
+		char *name                = list_iter_next(&iter);
+		struct dec_type *dec_type = map_get_str(ri.dec_types, name);
+		dec_type->letregion       = is_immediate_result(&ri, dec_type->type) &&
+		                      calls_recursion(&ri, name) &&
+		                      (!is_recursive(&ri, name) ||
+		                       ((is_tree_recursive(&ri, name) ||
+		                         (tail_calls_self(&ri, name) &&
+		                          has_immediate_params(&ri, dec_type->type))) &&
+		                        !tail_calls_other(&ri, name)));
+	}
+
+	map_free(ri.dec_types);
+	map_free(ri.refs);
+	map_free(ri.tail_refs);
+	map_free(ri.clauses);
+	set_free(ri.enum_datas);
+}
@@ -0,0 +1,18 @@
+#ifndef RACC_REGION_H
+#define RACC_REGION_H
+
+#include "ast.h"
+#include <arena.h>
+
+/* infers the region of each value declared without one. a top level value gets
+ * a region of its own, and a let bound value shares the region of the value it
+ * is bound in, which it must outlive. also marks the values which evaluate in
+ * a region of their own, reset when they return: those whose result can't
+ * refer to anything they allocate, being an Int, Char, Bool or enum, and which
+ * call into recursion, where garbage builds. a recursive value gets one per
+ * call if its calls run one after another, as in a tree walk, so each call's
+ * garbage is reset before the next. not if it tail calls another value, as
+ * that call would then have to return through it */
+void infer_regions(struct prog *prog, struct arena *arena);
+
+#endif
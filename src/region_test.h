@@ -0,0 +1,143 @@
+#include "arena.h"
+#include "ast.h"
+#include "lexer.h"
+#include "list.h"
+#include "parser.h"
+#include "region.h"
+#include "type_check.h"
+#include <ctest.h>
+#include <string.h>
+
+static struct dec_type *find_dec_type_in(struct list *stmts, char *name);
+
+static struct dec_type *find_dec_type_in_expr(struct expr *expr, char *name) {
+	switch (expr->expr_type) {
+	case EXPR_LET_IN: {
+		struct dec_type *dec_type = find_dec_type_in(expr->v.let_in.stmts, name);
+		return dec_type != NULL ? dec_type
+		                        : find_dec_type_in_expr(expr->v.let_in.value, name);
+	}
+	case EXPR_GROUPING: return find_dec_type_in_expr(expr->v.grouping, name);
+	default: return NULL;
+	}
+}
+
+/* finds the declaration of name, let bound ones included */
+static struct dec_type *find_dec_type_in(struct list *stmts, char *name) {
+	struct list_iter stmts_iter = list_iterate(stmts);
+	while (!list_iter_at_end(&stmts_iter)) {
+		struct stmt *stmt         = list_iter_next(&stmts_iter);
+		struct dec_type *dec_type = NULL;
+		if (stmt->type == STMT_DEC_TYPE &&
+		    strcmp(stmt->v.dec_type->name, name) == 0) {
+			return stmt->v.dec_type;
+		}
+		if (stmt->type == STMT_DEF_VALUE) {
+			dec_type = find_dec_type_in_expr(stmt->v.def_value->value, name);
+		}
+		if (dec_type != NULL) {
+			return dec_type;
+		}
+	}
+	return NULL;
+}
+
+/* infers the source's regions, then checks condition against prog */
+#define REGION_TEST(name, _source, _condition)                                 \
+	test name(void) {                                                            \
+		struct arena *arena = arena_alloc();                                       \
+		char *source        = _source;                                             \
+		struct error_log *log;                                                     \
+		struct token **tokens;                                                     \
+		struct prog *prog;                                                         \
+		log         = arena_push_struct_zero(arena, struct error_log);             \
+		log->source = source;                                                      \
+		tokens      = scan_tokens(source, arena, log);                             \
+		assert(log->had_error == 0);                                               \
+		prog = parse(tokens, arena, log);                                          \
+		assert(log->had_error == 0);                                               \
+		type_check(prog, arena, log);                                              \
+		assert(log->had_error == 0);                                               \
+		infer_regions(prog, arena);                                                \
+		EXPECT(_condition);                                                        \
+		arena_free(arena);                                                         \
+		PASS();                                                                    \
+	}
+
+#define REGION_OF(name) (find_dec_type_in(prog->stmts, name)->region_var)
+#define LETREGION_OF(name) (find_dec_type_in(prog->stmts, name)->letregion)
+
+REGION_TEST(infer_regions_gives_top_level_values_their_own,
+            "x :: Int;\n"
+            "x = 1;\n"
+            "y :: Int;\n"
+            "y = x;\n",
+            strcmp(REGION_OF("x"), "x") == 0 && strcmp(REGION_OF("y"), "y") == 0)
+
+REGION_TEST(infer_regions_keeps_given_regions,
+            "x :: Int 'r;\n"
+            "x = 1;\n",
+            strcmp(REGION_OF("x"), "r") == 0)
+
+REGION_TEST(infer_regions_puts_let_bound_values_in_their_users_region,
+            "main :: Int;\n"
+            "main = let y :: Int;\n"
+            "           y = 4;\n"
+            "        in y;\n",
+            strcmp(REGION_OF("y"), "main") == 0)
+
+#define BUILD_AND_SUM                                                          \
+	"build :: Int -> [Int];\n"                                                   \
+	"build 0 = [];\n"                                                            \
+	"build n = n : build (n - 1);\n"                                             \
+	"sum :: [Int] -> Int;\n"                                                     \
+	"sum [] = 0;\n"                                                              \
+	"sum (x:xs) = x + sum xs;\n"                                                 \
+	"work :: Int -> Int;\n"                                                      \
+	"work n = sum (build n);\n"                                                  \
+	"inc :: Int -> Int;\n"                                                       \
+	"inc n = n + 1;\n"
+
+REGION_TEST(infer_regions_scopes_calls_into_recursion,
+            BUILD_AND_SUM,
+            LETREGION_OF("work") && !LETREGION_OF("inc"))
+
+REGION_TEST(infer_regions_does_not_scope_linear_recursion,
+            BUILD_AND_SUM,
+            !LETREGION_OF("sum") && !LETREGION_OF("build"))
+
+REGION_TEST(infer_regions_scopes_each_call_of_tree_recursion,
+            "data Tree a { Node a (Tree a) (Tree a) | Leaf }\n"
+            "treeSize :: Tree Int -> Int;\n"
+            "treeSize Leaf = 0;\n"
+            "treeSize (Node _ lhs rhs) = 1 + treeSize lhs + treeSize rhs;\n",
+            LETREGION_OF("treeSize"))
+
+REGION_TEST(infer_regions_scopes_loops_over_immediates,
+            BUILD_AND_SUM "loop :: Int -> Int -> Int;\n"
+                          "loop acc 0 = acc;\n"
+                          "loop acc n = loop (acc + work 10) (n - 1);\n"
+                          "count :: [Int] -> Int -> Int;\n"
+                          "count [] acc = acc;\n"
+                          "count (_:xs) acc = count xs (acc + work 10);\n",
+            LETREGION_OF("loop") && !LETREGION_OF("count"))
+
+REGION_TEST(infer_regions_does_not_scope_mutual_tail_calls,
+            "isEven :: Int -> Bool;\n"
+            "isOdd :: Int -> Bool;\n"
+            "isEven 0 = True;\n"
+            "isEven n = isOdd (n - 1);\n"
+            "isOdd 0 = False;\n"
+            "isOdd n = isEven (n - 1);\n",
+            !LETREGION_OF("isEven") && !LETREGION_OF("isOdd"))
+
+void test_region_h(void) {
+	TEST(infer_regions_gives_top_level_values_their_own);
+	TEST(infer_regions_keeps_given_regions);
+	TEST(infer_regions_puts_let_bound_values_in_their_users_region);
+	TEST(infer_regions_scopes_calls_into_recursion);
+	TEST(infer_regions_does_not_scope_linear_recursion);
+	TEST(infer_regions_scopes_each_call_of_tree_recursion);
+	TEST(infer_regions_scopes_loops_over_immediates);
+	TEST(infer_regions_does_not_scope_mutual_tail_calls);
+}
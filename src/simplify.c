@@ -0,0 +1,1555 @@
+#include "simplify.h"
+#include "list.h"
+#include "map.h"
+#include "set.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+/* largest body (in expression nodes) inlined at a call, and how many inlinings
+ * deep a single call may be expanded, for -O1 and -O2 */
+#define INLINE_SIZE_SIMPLE  12
+#define INLINE_DEPTH_SIMPLE 4
+#define INLINE_SIZE_FULL    40
+#define INLINE_DEPTH_FULL   8
+
+/* most fused functions defined for one program */
+#define FUSIONS_MAX 64
+
+/* largest total size (in expression nodes) of the functions copied by
+ * specialisation at -O2, and most copies made of any one function */
+#define SPECIALISE_SIZE_MAX 2000
+#define SPECIALISATIONS_MAX 4
+
+struct simplifier {
+	struct arena *arena;
+	struct map *def_values;          /* char* -> list of struct def_value* */
+	struct map *dec_types;           /* char* -> struct dec_type* */
+	struct map *constructor_arities; /* char* -> size_t */
+	struct map *no_bindings;         /* always empty */
+	struct map *fusions;             /* "consumer producer" -> char* name */
+	struct map *specialisations;     /* "fn arg..." -> char* name */
+	struct map *specialised_counts;  /* char* -> size_t */
+	struct set *names;               /* char*, every name declared */
+	struct list *stmts_new;          /* definitions of new functions */
+	size_t fusions_len;
+	size_t fused_vars_len;
+	size_t specialised_size;
+	int specialise;
+	size_t inline_size_max;
+	size_t inline_depth_max;
+};
+
+enum match { MATCH_YES, MATCH_NO, MATCH_UNKNOWN };
+
+/* ========== LET FLOATING ========== */
+
+/* the names bound around an expr being floated, innermost first */
+struct renames {
+	struct map *names;  /* char* -> char*, let bound names to their new ones */
+	struct set *locals; /* names bound by patterns, which keep their name */
+	struct renames *outer;
+};
+
+static void collect_pattern_vars(struct expr *pattern, struct set *vars);
+
+/* the name stmt declares, if any */
+static char *stmt_name(struct stmt *stmt) {
+	switch (stmt->type) {
+	case STMT_DEC_TYPE: return stmt->v.dec_type->name;
+	case STMT_DEF_VALUE: return stmt->v.def_value->name;
+	default: return NULL;
+	}
+}
+
+static void collect_names(struct simplifier *s, struct list *stmts);
+
+static void collect_expr_names(struct simplifier *s, struct expr *expr) {
+	switch (expr->expr_type) {
+	case EXPR_LET_IN:
+		collect_names(s, expr->v.let_in.stmts);
+		collect_expr_names(s, expr->v.let_in.value);
+		break;
+	case EXPR_GROUPING: collect_expr_names(s, expr->v.grouping); break;
+	case EXPR_APPLICATION:
+		list_for_each(expr->v.application.expr_args,
+		              struct expr *,
+		              collect_expr_names(s, _value));
+		break;
+	default: break;
+	}
+}
+
+/* adds the names declared in stmts, let bound ones included, to s->names */
+static void collect_names(struct simplifier *s, struct list *stmts) {
+	struct list_iter iter = list_iterate(stmts);
+	while (!list_iter_at_end(&iter)) {
+		struct stmt *stmt = list_iter_next(&iter);
+		char *name        = stmt_name(stmt);
+		if (name != NULL) {
+			set_put_str(s->names, name);
+		}
+		if (stmt->type == STMT_DEF_VALUE) {
+			collect_expr_names(s, stmt->v.def_value->value);
+		}
+	}
+}
+
+/* an unused name for a let bound name, so it can't clash with another
+ * definition once floated to the top level */
+static char *floated_name(struct simplifier *s, char *name) {
+	size_t name_len = strlen(name) + 32;
+	char *name_new  = arena_push_array_zero(s->arena, name_len, char);
+	size_t suffix   = 0;
+	do {
+		sprintf(name_new, "%s_%ld", name, ++suffix);
+	} while (set_has_str(s->names, name_new));
+	set_put_str(s->names, name_new);
+	return name_new;
+}
+
+static char *renamed(struct renames *renames, char *name) {
+	for (; renames != NULL; renames = renames->outer) {
+		char *name_new;
+		if (renames->locals != NULL && set_has_str(renames->locals, name)) {
+			return name;
+		}
+		name_new =
+			renames->names == NULL ? NULL : map_get_str(renames->names, name);
+		if (name_new != NULL) {
+			return name_new;
+		}
+	}
+	return name;
+}
+
+static struct expr *float_lets(struct simplifier *s,
+                               struct expr *expr,
+                               struct list *stmts,
+                               struct renames *renames);
+
+static void float_stmt(struct simplifier *s,
+                       struct stmt *stmt,
+                       struct list *stmts,
+                       struct renames *renames) {
+	switch (stmt->type) {
+	case STMT_DEC_TYPE:
+		stmt->v.dec_type->name = renamed(renames, stmt->v.dec_type->name);
+		break;
+	case STMT_DEF_VALUE: {
+		struct def_value *def_value = stmt->v.def_value;
+		struct renames params;
+		params.names  = NULL;
+		params.locals = set_new();
+		params.outer  = renames;
+		list_for_each(def_value->expr_params,
+		              struct expr *,
+		              collect_pattern_vars(_value, params.locals));
+		def_value->name  = renamed(renames, def_value->name);
+		def_value->value = float_lets(s, def_value->value, stmts, &params);
+		set_free(params.locals);
+		break;
+	}
+	default: break;
+	}
+	list_append(stmts, stmt);
+}
+
+/* moves the statements of let..in exprs into stmts, which code_gen would
+ * otherwise do, so the simplifier sees them as top level definitions. each
+ * let bound name is given a new one, as others may bind the same name */
+static struct expr *float_lets(struct simplifier *s,
+                               struct expr *expr,
+                               struct list *stmts,
+                               struct renames *renames) {
+	switch (expr->expr_type) {
+	case EXPR_IDENTIFIER:
+		expr->v.identifier = renamed(renames, expr->v.identifier);
+		return expr;
+	case EXPR_LET_IN: {
+		struct renames bindings;
+		struct list_iter iter;
+		struct expr *value;
+		bindings.names  = map_new();
+		bindings.locals = NULL;
+		bindings.outer  = renames;
+		iter            = list_iterate(expr->v.let_in.stmts);
+		while (!list_iter_at_end(&iter)) {
+			char *name = stmt_name(list_iter_next(&iter));
+			if (name != NULL && map_get_str(bindings.names, name) == NULL) {
+				map_put_str(bindings.names, name, floated_name(s, name));
+			}
+		}
+		list_for_each(expr->v.let_in.stmts,
+		              struct stmt *,
+		              float_stmt(s, _value, stmts, &bindings));
+		value = float_lets(s, expr->v.let_in.value, stmts, &bindings);
+		map_free(bindings.names);
+		return value;
+	}
+	case EXPR_GROUPING: return float_lets(s, expr->v.grouping, stmts, renames);
+	case EXPR_APPLICATION: {
+		struct list *expr_args_new = list_new(s->arena);
+		list_map(expr_args_new,
+		         expr->v.application.expr_args,
+		         struct expr *,
+		         float_lets(s, _value, stmts, renames));
+		expr->v.application.fn        = renamed(renames, expr->v.application.fn);
+		expr->v.application.expr_args = expr_args_new;
+		return expr;
+	}
+	default: return expr;
+	}
+}
+
+/* ========== EXPRESSIONS ========== */
+
+static int is_constructor_name(char *name) {
+	return isupper(name[0]) || strcmp(name, ":") == 0;
+}
+
+static int is_variable_name(char *name) {
+	return !is_constructor_name(name) && name[0] != '_';
+}
+
+/* whether expr is a saturated constructor, so already in normal form */
+static int is_constructor_value(struct simplifier *s, struct expr *expr) {
+	switch (expr->expr_type) {
+	case EXPR_LIST_NULL: return 1;
+	case EXPR_IDENTIFIER: return isupper(expr->v.identifier[0]);
+	case EXPR_APPLICATION:
+		return is_constructor_name(expr->v.application.fn) &&
+		       (size_t)map_get_str(s->constructor_arities,
+		                           expr->v.application.fn) ==
+		         list_length(expr->v.application.expr_args);
+	default: return 0;
+	}
+}
+
+static char *constructor_name(struct expr *expr) {
+	switch (expr->expr_type) {
+	case EXPR_LIST_NULL: return "[]";
+	case EXPR_IDENTIFIER: return expr->v.identifier;
+	case EXPR_APPLICATION: return expr->v.application.fn;
+	default: return NULL;
+	}
+}
+
+/* exprs which can be duplicated without duplicating work */
+static int is_trivial(struct expr *expr) {
+	switch (expr->expr_type) {
+	case EXPR_IDENTIFIER:
+	case EXPR_LIT_INT:
+	case EXPR_LIT_DOUBLE:
+	case EXPR_LIT_CHAR:
+	case EXPR_LIT_BOOL:
+	case EXPR_LIST_NULL: return 1;
+	default: return 0;
+	}
+}
+
+static size_t expr_size(struct expr *expr) {
+	size_t size = 1;
+	if (expr->expr_type == EXPR_APPLICATION) {
+		list_for_each(expr->v.application.expr_args,
+		              struct expr *,
+		              size += expr_size(_value));
+	}
+	return size;
+}
+
+static size_t count_uses(struct expr *expr, char *name) {
+	size_t uses = 0;
+	switch (expr->expr_type) {
+	case EXPR_IDENTIFIER: return strcmp(expr->v.identifier, name) == 0;
+	case EXPR_APPLICATION:
+		uses = strcmp(expr->v.application.fn, name) == 0;
+		list_for_each(expr->v.application.expr_args,
+		              struct expr *,
+		              uses += count_uses(_value, name));
+		return uses;
+	default: return 0;
+	}
+}
+
+/* whether expr refers to a name, not bound in bindings, which is shadowed by
+ * a variable in locals */
+static int
+mentions_locals(struct expr *expr, struct map *bindings, struct set *locals) {
+	switch (expr->expr_type) {
+	case EXPR_IDENTIFIER:
+		return map_get_str(bindings, expr->v.identifier) == NULL &&
+		       set_has_str(locals, expr->v.identifier);
+	case EXPR_APPLICATION:
+		if (map_get_str(bindings, expr->v.application.fn) == NULL &&
+		    set_has_str(locals, expr->v.application.fn)) {
+			return 1;
+		}
+		list_for_each(expr->v.application.expr_args,
+		              struct expr *,
+		              if (mentions_locals(_value, bindings, locals)) return 1;);
+		return 0;
+	default: return 0;
+	}
+}
+
+static void collect_pattern_vars(struct expr *pattern, struct set *vars) {
+	switch (pattern->expr_type) {
+	case EXPR_IDENTIFIER:
+		if (is_variable_name(pattern->v.identifier)) {
+			set_put_str(vars, pattern->v.identifier);
+		}
+		break;
+	case EXPR_APPLICATION:
+		list_for_each(pattern->v.application.expr_args,
+		              struct expr *,
+		              collect_pattern_vars(_value, vars));
+		break;
+	case EXPR_GROUPING: collect_pattern_vars(pattern->v.grouping, vars); break;
+	default: break;
+	}
+}
+
+/* copies expr, replacing the variables bound in bindings. NULL if a variable
+ * being applied is bound to an expr which can't be */
+static struct expr *
+substitute(struct simplifier *s, struct expr *expr, struct map *bindings) {
+	struct expr *copy = arena_push_struct_zero(s->arena, struct expr);
+	struct expr *bound;
+
+	switch (expr->expr_type) {
+	case EXPR_IDENTIFIER:
+		bound = map_get_str(bindings, expr->v.identifier);
+		if (bound != NULL) {
+			return substitute(s, bound, s->no_bindings);
+		}
+		break;
+	case EXPR_APPLICATION: {
+		struct list *expr_args = list_new(s->arena);
+		char *fn               = expr->v.application.fn;
+
+		/* beta reduce applications of bound variables */
+		bound = map_get_str(bindings, fn);
+		if (bound != NULL) {
+			switch (bound->expr_type) {
+			case EXPR_IDENTIFIER: fn = bound->v.identifier; break;
+			case EXPR_APPLICATION:
+				fn = bound->v.application.fn;
+				list_for_each(bound->v.application.expr_args,
+				              struct expr *,
+				              list_append(expr_args,
+				                          substitute(s, _value, s->no_bindings)));
+				break;
+			default: return NULL;
+			}
+		}
+
+		list_for_each(expr->v.application.expr_args,
+		              struct expr *,
+		              struct expr *expr_arg = substitute(s, _value, bindings);
+		              if (expr_arg == NULL) return NULL;
+		              list_append(expr_args, expr_arg));
+
+		*copy                         = *expr;
+		copy->v.application.fn        = fn;
+		copy->v.application.expr_args = expr_args;
+		return copy;
+	}
+	default: break;
+	}
+
+	*copy = *expr;
+	return copy;
+}
+
+/* ========== CLAUSE SELECTION ========== */
+
+static enum match match_patterns(struct simplifier *s,
+                                 struct list *patterns,
+                                 struct list *exprs,
+                                 struct map *bindings,
+                                 int *is_known);
+
+/* statically matches a pattern against an argument, binding its variables.
+ * is_known is set if a constructor or literal had to be inspected */
+static enum match match_pattern(struct simplifier *s,
+                                struct expr *pattern,
+                                struct expr *expr,
+                                struct map *bindings,
+                                int *is_known) {
+	while (pattern->expr_type == EXPR_GROUPING) {
+		pattern = pattern->v.grouping;
+	}
+
+	switch (pattern->expr_type) {
+	case EXPR_IDENTIFIER:
+		if (!is_constructor_name(pattern->v.identifier)) {
+			if (is_variable_name(pattern->v.identifier)) {
+				map_put_str(bindings, pattern->v.identifier, expr);
+			}
+			return MATCH_YES;
+		}
+		/* fall through */
+	case EXPR_LIST_NULL:
+	case EXPR_APPLICATION:
+		if (!is_constructor_value(s, expr)) {
+			return MATCH_UNKNOWN;
+		}
+		*is_known = 1;
+		if (strcmp(constructor_name(pattern), constructor_name(expr)) != 0) {
+			return MATCH_NO;
+		}
+		if (pattern->expr_type != EXPR_APPLICATION) {
+			return MATCH_YES;
+		}
+		return match_patterns(s,
+		                      pattern->v.application.expr_args,
+		                      expr->v.application.expr_args,
+		                      bindings,
+		                      is_known);
+	case EXPR_LIT_INT:
+		if (expr->expr_type != EXPR_LIT_INT) {
+			return MATCH_UNKNOWN;
+		}
+		*is_known = 1;
+		return pattern->v.lit_int == expr->v.lit_int ? MATCH_YES : MATCH_NO;
+	case EXPR_LIT_CHAR:
+		if (expr->expr_type != EXPR_LIT_CHAR) {
+			return MATCH_UNKNOWN;
+		}
+		*is_known = 1;
+		return pattern->v.lit_char == expr->v.lit_char ? MATCH_YES : MATCH_NO;
+	case EXPR_LIT_BOOL:
+		if (expr->expr_type != EXPR_LIT_BOOL) {
+			return MATCH_UNKNOWN;
+		}
+		*is_known = 1;
+		return pattern->v.lit_bool == expr->v.lit_bool ? MATCH_YES : MATCH_NO;
+	default: return MATCH_UNKNOWN;
+	}
+}
+
+/* matches left to right like the generated code, stopping at the first
+ * pattern which doesn't statically match */
+static enum match match_patterns(struct simplifier *s,
+                                 struct list *patterns,
+                                 struct list *exprs,
+                                 struct map *bindings,
+                                 int *is_known) {
+	struct list_iter exprs_iter = list_iterate(exprs);
+	list_for_each(patterns,
+	              struct expr *,
+	              enum match match = match_pattern(s,
+	                                               _value,
+	                                               list_iter_next(&exprs_iter),
+	                                               bindings,
+	                                               is_known);
+	              if (match != MATCH_YES) return match;);
+	return MATCH_YES;
+}
+
+/* ========== INLINING ========== */
+
+/* whether the variables in pattern can be replaced by their bound exprs in
+ * body without duplicating work */
+static int substitution_shares(struct expr *pattern,
+                               struct expr *body,
+                               struct map *bindings) {
+	switch (pattern->expr_type) {
+	case EXPR_IDENTIFIER:
+		if (is_variable_name(pattern->v.identifier) &&
+		    count_uses(body, pattern->v.identifier) > 1) {
+			return is_trivial(map_get_str(bindings, pattern->v.identifier));
+		}
+		return 1;
+	case EXPR_APPLICATION:
+		list_for_each(pattern->v.application.expr_args,
+		              struct expr *,
+		              if (!substitution_shares(_value, body, bindings)) return 0;);
+		return 1;
+	case EXPR_GROUPING:
+		return substitution_shares(pattern->v.grouping, body, bindings);
+	default: return 1;
+	}
+}
+
+static int can_inline(struct simplifier *s,
+                      struct def_value *def_value,
+                      struct map *bindings,
+                      struct set *locals,
+                      int is_known) {
+	if (expr_size(def_value->value) > s->inline_size_max) {
+		return 0;
+	}
+	/* only unroll recursive functions when a clause was picked statically */
+	if (!is_known && count_uses(def_value->value, def_value->name) > 0) {
+		return 0;
+	}
+	if (mentions_locals(def_value->value, bindings, locals)) {
+		return 0;
+	}
+	list_for_each(
+		def_value->expr_params,
+		struct expr *,
+		if (!substitution_shares(_value, def_value->value, bindings)) return 0;);
+	return 1;
+}
+
+/* applies any arguments past the function's arity to the inlined body */
+static struct expr *apply_extra_args(struct simplifier *s,
+                                     struct expr *body,
+                                     struct expr *call,
+                                     size_t arity) {
+	struct list_iter expr_args_iter =
+		list_iterate(call->v.application.expr_args);
+	size_t i;
+
+	if (list_length(call->v.application.expr_args) > arity) {
+		if (body->expr_type == EXPR_IDENTIFIER) {
+			char *fn                     = body->v.identifier;
+			body->expr_type              = EXPR_APPLICATION;
+			body->v.application.fn        = fn;
+			body->v.application.expr_args = list_new(s->arena);
+		} else if (body->expr_type != EXPR_APPLICATION) {
+			return NULL;
+		}
+		for (i = 0; i < arity; i++) {
+			list_iter_next(&expr_args_iter);
+		}
+		while (!list_iter_at_end(&expr_args_iter)) {
+			list_append(body->v.application.expr_args,
+			            list_iter_next(&expr_args_iter));
+		}
+	}
+
+	body->type = call->type;
+	return body;
+}
+
+/* the body of the clause a call selects, with the call's arguments
+ * substituted in. NULL if the call should be left as it is */
+static struct expr *
+inline_call(struct simplifier *s, struct expr *call, struct set *locals) {
+	char *fn                    = call->v.application.fn;
+	struct def_value *chosen    = NULL;
+	struct map *bindings        = NULL;
+	struct expr *body           = NULL;
+	struct list *def_values;
+	struct list_iter def_values_iter;
+	size_t arity;
+	int is_known = 0;
+
+	if (set_has_str(locals, fn)) {
+		return NULL;
+	}
+	def_values = map_get_str(s->def_values, fn);
+	if (def_values == NULL) {
+		return NULL;
+	}
+	arity = list_length(((struct def_value *)list_head(def_values))->expr_params);
+	if (arity == 0 || list_length(call->v.application.expr_args) < arity) {
+		return NULL;
+	}
+
+	def_values_iter = list_iterate(def_values);
+	while (chosen == NULL && !list_iter_at_end(&def_values_iter)) {
+		struct def_value *def_value = list_iter_next(&def_values_iter);
+		enum match match;
+
+		bindings = map_new();
+		match    = match_patterns(s,
+		                          def_value->expr_params,
+		                          call->v.application.expr_args,
+		                          bindings,
+		                          &is_known);
+		if (match == MATCH_YES) {
+			chosen = def_value;
+		} else {
+			map_free(bindings);
+			if (match == MATCH_UNKNOWN) {
+				return NULL;
+			}
+		}
+	}
+
+	if (chosen == NULL) {
+		return NULL;
+	}
+	if (can_inline(s, chosen, bindings, locals, is_known)) {
+		body = substitute(s, chosen->value, bindings);
+		if (body != NULL) {
+			body = apply_extra_args(s, body, call, arity);
+		}
+	}
+	map_free(bindings);
+	return body;
+}
+
+/* ========== FUSION ========== */
+
+static void add_def_value(struct simplifier *s, struct def_value *def_value) {
+	struct list *def_values = map_get_str(s->def_values, def_value->name);
+	if (def_values == NULL) {
+		def_values = list_new(s->arena);
+		map_put_str(s->def_values, def_value->name, def_values);
+	}
+	list_append(def_values, def_value);
+}
+
+
+/* a function which takes apart a list argument, with a [] clause and an
+ * (x : xs) clause using xs only to recurse with its other parameters
+ * unchanged. a call to it on a list being produced can instead run both
+ * functions as a single fused function, without building the list */
+struct consumer {
+	char *name;
+	size_t arity;
+	size_t list_index;
+	struct def_value *nil;  /* NULL if there is no [] clause */
+	struct def_value *cons;
+	char *head_var;         /* NULL for _ */
+	char *tail_var;         /* NULL for _ */
+	struct dec_type *dec_type;
+};
+
+struct fusion {
+	struct consumer *consumer;
+	char *producer;
+	char *name;
+	struct expr **params;  /* identifiers for the consumer's other params */
+	struct set *producer_vars;
+};
+
+static struct expr *strip_groupings(struct expr *expr) {
+	while (expr->expr_type == EXPR_GROUPING) {
+		expr = expr->v.grouping;
+	}
+	return expr;
+}
+
+/* names which can be combined into the C name of a fused function */
+static int is_plain_name(char *name) {
+	if (!isalpha(name[0])) {
+		return 0;
+	}
+	for (; *name != '\0'; name++) {
+		if (!isalnum(*name) && *name != '_') {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static int is_variable_pattern(struct expr *pattern) {
+	pattern = strip_groupings(pattern);
+	return pattern->expr_type == EXPR_IDENTIFIER &&
+	       !is_constructor_name(pattern->v.identifier);
+}
+
+/* the variable a variable pattern binds, NULL for _ */
+static char *pattern_var(struct expr *pattern) {
+	pattern = strip_groupings(pattern);
+	return is_variable_name(pattern->v.identifier) ? pattern->v.identifier
+	                                               : NULL;
+}
+
+static int is_cons_pattern(struct expr *pattern) {
+	pattern = strip_groupings(pattern);
+	return pattern->expr_type == EXPR_APPLICATION &&
+	       strcmp(pattern->v.application.fn, ":") == 0 &&
+	       is_variable_pattern(list_head(pattern->v.application.expr_args)) &&
+	       is_variable_pattern(list_last(pattern->v.application.expr_args));
+}
+
+/* the type of a function's ith parameter's arrow, or its result when i is
+ * its arity */
+static struct type *function_type_at(struct type *type, size_t i) {
+	for (; i > 0; i--) {
+		type = list_last(type->type_args);
+	}
+	return type;
+}
+
+static struct type *function_param_type(struct type *type, size_t i) {
+	return list_head(function_type_at(type, i)->type_args);
+}
+
+static int is_recursive_call(struct consumer *c, struct expr *expr) {
+	size_t i = 0;
+	if (expr->expr_type != EXPR_APPLICATION ||
+	    strcmp(expr->v.application.fn, c->name) != 0 ||
+	    list_length(expr->v.application.expr_args) != c->arity) {
+		return 0;
+	}
+	list_for_each(
+		expr->v.application.expr_args, struct expr *,
+		struct expr *expr_arg = strip_groupings(_value);
+		char *var             = i == c->list_index
+		                          ? c->tail_var
+		                          : pattern_var(list_get(c->cons->expr_params, i));
+		i++;
+		if (expr_arg->expr_type != EXPR_IDENTIFIER || var == NULL ||
+	      strcmp(expr_arg->v.identifier, var) != 0) return 0;);
+	return 1;
+}
+
+static size_t count_recursive_calls(struct consumer *c, struct expr *expr) {
+	size_t calls = 0;
+	if (is_recursive_call(c, expr)) {
+		return 1;
+	}
+	if (expr->expr_type == EXPR_APPLICATION) {
+		list_for_each(expr->v.application.expr_args,
+		              struct expr *,
+		              calls += count_recursive_calls(c, _value));
+	}
+	return calls;
+}
+
+static int is_consumer_at(struct list *def_values,
+                          size_t list_index,
+                          struct consumer *c) {
+	struct list_iter def_values_iter;
+	struct expr *cons_pattern;
+	size_t calls;
+
+	c->list_index = list_index;
+	c->nil        = NULL;
+	c->cons       = NULL;
+
+	def_values_iter = list_iterate(def_values);
+	while (!list_iter_at_end(&def_values_iter)) {
+		struct def_value *def_value  = list_iter_next(&def_values_iter);
+		struct list_iter params_iter = list_iterate(def_value->expr_params);
+		size_t i                     = 0;
+
+		while (!list_iter_at_end(&params_iter)) {
+			struct expr *pattern = strip_groupings(list_iter_next(&params_iter));
+			if (i++ != list_index) {
+				if (!is_variable_pattern(pattern)) {
+					return 0;
+				}
+			} else if (pattern->expr_type == EXPR_LIST_NULL && c->nil == NULL) {
+				c->nil = def_value;
+			} else if (is_cons_pattern(pattern) && c->cons == NULL) {
+				c->cons = def_value;
+			} else {
+				return 0;
+			}
+		}
+	}
+	if (c->cons == NULL) {
+		return 0;
+	}
+
+	cons_pattern =
+		strip_groupings(list_get(c->cons->expr_params, list_index));
+	c->head_var = pattern_var(list_head(cons_pattern->v.application.expr_args));
+	c->tail_var = pattern_var(list_last(cons_pattern->v.application.expr_args));
+
+	/* the tail may only be used to recurse */
+	calls = c->tail_var == NULL ? 0 : count_recursive_calls(c, c->cons->value);
+	return count_uses(c->cons->value, c->name) == calls &&
+	       (c->tail_var == NULL ||
+	        count_uses(c->cons->value, c->tail_var) == calls);
+}
+
+static int find_consumer(struct simplifier *s, char *name, struct consumer *c) {
+	struct list *def_values = map_get_str(s->def_values, name);
+	size_t list_index;
+
+	c->name     = name;
+	c->dec_type = map_get_str(s->dec_types, name);
+	if (def_values == NULL || c->dec_type == NULL || !is_plain_name(name) ||
+	    list_length(def_values) > 2) {
+		return 0;
+	}
+	c->arity =
+		list_length(((struct def_value *)list_head(def_values))->expr_params);
+	for (list_index = 0; list_index < c->arity; list_index++) {
+		if (is_consumer_at(def_values, list_index, c)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* a function returning a list built by at least one of its clauses */
+static int is_producer(struct simplifier *s, char *name, size_t args_len) {
+	struct list *def_values    = map_get_str(s->def_values, name);
+	struct dec_type *dec_type = map_get_str(s->dec_types, name);
+	size_t arity;
+
+	if (def_values == NULL || dec_type == NULL || !is_plain_name(name)) {
+		return 0;
+	}
+	arity =
+		list_length(((struct def_value *)list_head(def_values))->expr_params);
+	if (arity == 0 || arity != args_len ||
+	    strcmp(function_type_at(dec_type->type, arity)->name, "[]") != 0) {
+		return 0;
+	}
+	list_for_each(def_values,
+	              struct def_value *,
+	              struct expr *body = strip_groupings(_value->value);
+	              if (body->expr_type == EXPR_APPLICATION &&
+	                  strcmp(body->v.application.fn, ":") == 0) return 1;);
+	return 0;
+}
+
+static struct expr *
+new_application(struct simplifier *s, char *fn, struct type *type) {
+	struct expr *expr = arena_push_struct_zero(s->arena, struct expr);
+	expr->expr_type                = EXPR_APPLICATION;
+	expr->v.application.fn        = fn;
+	expr->v.application.expr_args = list_new(s->arena);
+	expr->type                    = type;
+	return expr;
+}
+
+/* the rest of the consumer's work on a list tail: a call to the fused
+ * function if the producer makes it, otherwise the consumer itself */
+static struct expr *
+fused_tail(struct simplifier *s, struct fusion *f, struct expr *tail) {
+	struct consumer *c = f->consumer;
+	struct type *type  = function_type_at(c->dec_type->type, c->arity);
+	struct expr *call;
+	size_t i;
+
+	tail = strip_groupings(tail);
+	if (tail->expr_type == EXPR_APPLICATION &&
+	    strcmp(tail->v.application.fn, f->producer) == 0 &&
+	    is_producer(s, f->producer, list_length(tail->v.application.expr_args))) {
+		call = new_application(s, f->name, type);
+		for (i = 0; i < c->arity; i++) {
+			if (i != c->list_index) {
+				list_append(call->v.application.expr_args, f->params[i]);
+			}
+		}
+		list_for_each(tail->v.application.expr_args,
+		              struct expr *,
+		              list_append(call->v.application.expr_args, _value));
+		return call;
+	}
+
+	call = new_application(s, c->name, type);
+	for (i = 0; i < c->arity; i++) {
+		list_append(call->v.application.expr_args,
+		            i == c->list_index ? tail : f->params[i]);
+	}
+	return call;
+}
+
+/* copies expr, replacing the consumer's recursive calls with its tail var */
+static struct expr *replace_recursive_calls(struct simplifier *s,
+                                            struct consumer *c,
+                                            struct expr *expr) {
+	struct expr *copy;
+	if (is_recursive_call(c, expr)) {
+		copy               = arena_push_struct_zero(s->arena, struct expr);
+		copy->expr_type    = EXPR_IDENTIFIER;
+		copy->v.identifier = c->tail_var;
+		copy->type         = expr->type;
+		return copy;
+	}
+	if (expr->expr_type != EXPR_APPLICATION) {
+		return expr;
+	}
+	copy  = arena_push_struct_zero(s->arena, struct expr);
+	*copy = *expr;
+	copy->v.application.expr_args = list_new(s->arena);
+	list_map(copy->v.application.expr_args,
+	         expr->v.application.expr_args,
+	         struct expr *,
+	         replace_recursive_calls(s, c, _value));
+	return copy;
+}
+
+/* a consumer clause's body applied to the head and fused tail of a list */
+static struct expr *consumer_body(struct simplifier *s,
+                                  struct fusion *f,
+                                  struct def_value *clause,
+                                  struct expr *head,
+                                  struct expr *tail) {
+	struct consumer *c   = f->consumer;
+	struct map *bindings = map_new();
+	struct expr *body    = clause->value;
+	size_t i             = 0;
+
+	list_for_each(clause->expr_params,
+	              struct expr *,
+	              if (i != c->list_index && pattern_var(_value) != NULL)
+		              map_put_str(bindings, pattern_var(_value), f->params[i]);
+	              i++);
+
+	if (clause == c->cons) {
+		if (c->head_var != NULL) {
+			if (count_uses(body, c->head_var) > 1 && !is_trivial(head)) {
+				map_free(bindings);
+				return NULL;
+			}
+			map_put_str(bindings, c->head_var, head);
+		}
+		if (c->tail_var != NULL) {
+			body = replace_recursive_calls(s, c, body);
+			map_put_str(bindings, c->tail_var, tail);
+		}
+	}
+
+	/* the producer's head is put in scope of the consumer's names */
+	if (mentions_locals(body, bindings, f->producer_vars)) {
+		map_free(bindings);
+		return NULL;
+	}
+	body = substitute(s, body, bindings);
+	map_free(bindings);
+	return body;
+}
+
+static struct expr *
+fused_body(struct simplifier *s, struct fusion *f, struct expr *body) {
+	struct consumer *c = f->consumer;
+	body               = strip_groupings(body);
+	if (body->expr_type == EXPR_LIST_NULL && c->nil != NULL) {
+		return consumer_body(s, f, c->nil, NULL, NULL);
+	}
+	if (body->expr_type == EXPR_APPLICATION &&
+	    strcmp(body->v.application.fn, ":") == 0) {
+		return consumer_body(
+			s,
+			f,
+			c->cons,
+			list_head(body->v.application.expr_args),
+			fused_tail(s, f, list_last(body->v.application.expr_args)));
+	}
+	return fused_tail(s, f, body);
+}
+
+static struct type *new_arrow(struct simplifier *s,
+                              struct type *arrow,
+                              struct type *lhs,
+                              struct type *rhs) {
+	struct type *type = arena_push_struct_zero(s->arena, struct type);
+	*type             = *arrow;
+	type->type_args   = list_new(s->arena);
+	list_append(type->type_args, lhs);
+	list_append(type->type_args, rhs);
+	return type;
+}
+
+/* consumer params other than the list, then the producer's params */
+static struct type *fused_type(struct simplifier *s,
+                               struct consumer *c,
+                               struct dec_type *producer) {
+	size_t producer_arity = 0;
+	struct type *type;
+	size_t i;
+
+	for (type = producer->type; strcmp(type->name, "->") == 0;
+	     type = list_last(type->type_args)) {
+		producer_arity++;
+	}
+
+	type = function_type_at(c->dec_type->type, c->arity);
+	for (i = producer_arity; i > 0; i--) {
+		type = new_arrow(s,
+		                 c->dec_type->type,
+		                 function_param_type(producer->type, i - 1),
+		                 type);
+	}
+	for (i = c->arity; i > 0; i--) {
+		if (i - 1 != c->list_index) {
+			type = new_arrow(s,
+			                 c->dec_type->type,
+			                 function_param_type(c->dec_type->type, i - 1),
+			                 type);
+		}
+	}
+	return type;
+}
+
+static struct stmt *
+new_stmt(struct simplifier *s, enum stmt_type type, void *value) {
+	struct stmt *stmt = arena_push_struct_zero(s->arena, struct stmt);
+	stmt->type        = type;
+	if (type == STMT_DEC_TYPE) {
+		stmt->v.dec_type = value;
+	} else {
+		stmt->v.def_value = value;
+	}
+	return stmt;
+}
+
+/* an unused name joining two names */
+static char *joined_name(struct simplifier *s, char *first, char *second) {
+	size_t name_len = strlen(first) + strlen(second) + 32;
+	char *name      = arena_push_array_zero(s->arena, name_len, char);
+	size_t suffix   = 0;
+	sprintf(name, "%s_%s", first, second);
+	while (map_get_str(s->def_values, name) != NULL ||
+	       map_get_str(s->dec_types, name) != NULL) {
+		sprintf(name, "%s_%s_%ld", first, second, ++suffix);
+	}
+	return name;
+}
+
+/* the fused function's clause for one of the producer's clauses */
+static struct def_value *fused_clause(struct simplifier *s,
+                                      struct fusion *f,
+                                      struct def_value *producer_clause) {
+	struct consumer *c = f->consumer;
+	struct def_value *def_value =
+		arena_push_struct_zero(s->arena, struct def_value);
+	size_t i;
+
+	def_value->name        = f->name;
+	def_value->expr_params = list_new(s->arena);
+	for (i = 0; i < c->arity; i++) {
+		if (i != c->list_index) {
+			list_append(def_value->expr_params, f->params[i]);
+		}
+	}
+	list_for_each(producer_clause->expr_params,
+	              struct expr *,
+	              list_append(def_value->expr_params, _value));
+
+	f->producer_vars = set_new();
+	list_for_each(producer_clause->expr_params,
+	              struct expr *,
+	              collect_pattern_vars(_value, f->producer_vars));
+	def_value->value = fused_body(s, f, producer_clause->value);
+	set_free(f->producer_vars);
+
+	return def_value->value == NULL ? NULL : def_value;
+}
+
+/* defines the fusion of a consumer with a producer, returning its name, or
+ * NULL if they can't be fused */
+static char *fuse(struct simplifier *s, struct consumer *c, char *producer) {
+	struct list *producer_def_values = map_get_str(s->def_values, producer);
+	struct list *def_values          = list_new(s->arena);
+	struct dec_type *dec_type;
+	struct fusion f;
+	char *key;
+	size_t i;
+
+	key = arena_push_array_zero(
+		s->arena, strlen(c->name) + strlen(producer) + 2, char);
+	sprintf(key, "%s %s", c->name, producer);
+	f.name = map_get_str(s->fusions, key);
+	if (f.name != NULL) {
+		return f.name[0] == '\0' ? NULL : f.name;
+	}
+	if (s->fusions_len++ == FUSIONS_MAX) {
+		return NULL;
+	}
+
+	f.consumer = c;
+	f.producer = producer;
+	f.name     = joined_name(s, c->name, producer);
+	f.params   = arena_push_array_zero(s->arena, c->arity, struct expr *);
+	for (i = 0; i < c->arity; i++) {
+		char *var = arena_push_array_zero(s->arena, 32, char);
+		sprintf(var, "fuse__%ld", s->fused_vars_len++);
+		f.params[i]               = arena_push_struct_zero(s->arena, struct expr);
+		f.params[i]->expr_type    = EXPR_IDENTIFIER;
+		f.params[i]->v.identifier = var;
+		f.params[i]->type = function_param_type(c->dec_type->type, i);
+	}
+
+	list_for_each(producer_def_values,
+	              struct def_value *,
+	              struct def_value *def_value = fused_clause(s, &f, _value);
+	              if (def_value == NULL) {
+		              map_put_str(s->fusions, key, "");
+		              return NULL;
+	              } list_append(def_values, def_value));
+
+	dec_type             = arena_push_struct_zero(s->arena, struct dec_type);
+	dec_type->name       = f.name;
+	dec_type->type       = fused_type(s, c, map_get_str(s->dec_types, producer));
+	dec_type->region_var = c->dec_type->region_var;
+	map_put_str(s->dec_types, f.name, dec_type);
+	map_put_str(s->fusions, key, f.name);
+
+	list_append(s->stmts_new, new_stmt(s, STMT_DEC_TYPE, dec_type));
+	list_for_each(def_values,
+	              struct def_value *,
+	              add_def_value(s, _value);
+	              list_append(s->stmts_new, new_stmt(s, STMT_DEF_VALUE, _value)));
+	return f.name;
+}
+
+/* rewrites a consumer applied to a producer's result into a call to their
+ * fusion. NULL if the call isn't one */
+static struct expr *
+fuse_call(struct simplifier *s, struct expr *call, struct set *locals) {
+	struct consumer c;
+	struct expr *list_arg;
+	struct expr *fused;
+	char *name;
+	size_t i = 0;
+
+	if (set_has_str(locals, call->v.application.fn) ||
+	    !find_consumer(s, call->v.application.fn, &c) ||
+	    list_length(call->v.application.expr_args) != c.arity) {
+		return NULL;
+	}
+	list_arg = strip_groupings(
+		list_get(call->v.application.expr_args, c.list_index));
+	if (list_arg->expr_type != EXPR_APPLICATION ||
+	    set_has_str(locals, list_arg->v.application.fn) ||
+	    !is_producer(s,
+	                 list_arg->v.application.fn,
+	                 list_length(list_arg->v.application.expr_args))) {
+		return NULL;
+	}
+
+	name = fuse(s, &c, list_arg->v.application.fn);
+	if (name == NULL) {
+		return NULL;
+	}
+	fused = new_application(s, name, call->type);
+	list_for_each(call->v.application.expr_args,
+	              struct expr *,
+	              if (i++ != c.list_index)
+		              list_append(fused->v.application.expr_args, _value));
+	list_for_each(list_arg->v.application.expr_args,
+	              struct expr *,
+	              list_append(fused->v.application.expr_args, _value));
+	return fused;
+}
+
+/* ========== SPECIALISATION ========== */
+
+/* a copy of a function for calls passing known functions to parameters which
+ * it only passes on unchanged when recursing. substituting them in turns
+ * applications of those parameters into direct calls, which can be inlined */
+struct specialisation {
+	char *fn;
+	char *name;
+	size_t arity;
+	struct expr **args; /* the known function at each specialised param */
+	struct dec_type *dec_type;
+};
+
+/* a top level function named by expr, which isn't shadowed by a local */
+static char *
+known_function(struct simplifier *s, struct expr *expr, struct set *locals) {
+	struct list *def_values;
+	expr = strip_groupings(expr);
+	if (expr->expr_type != EXPR_IDENTIFIER ||
+	    set_has_str(locals, expr->v.identifier) ||
+	    !is_plain_name(expr->v.identifier)) {
+		return NULL;
+	}
+	def_values = map_get_str(s->def_values, expr->v.identifier);
+	if (def_values == NULL ||
+	    list_length(
+	      ((struct def_value *)list_head(def_values))->expr_params) == 0) {
+		return NULL;
+	}
+	return expr->v.identifier;
+}
+
+/* whether every saturated call of fn in expr passes var on as its ith arg */
+static int passes_on(struct expr *expr,
+                     char *fn,
+                     size_t arity,
+                     size_t i,
+                     char *var) {
+	if (expr->expr_type != EXPR_APPLICATION) {
+		return 1;
+	}
+	if (strcmp(expr->v.application.fn, fn) == 0 &&
+	    list_length(expr->v.application.expr_args) >= arity) {
+		struct expr *expr_arg =
+			strip_groupings(list_get(expr->v.application.expr_args, i));
+		if (var == NULL || expr_arg->expr_type != EXPR_IDENTIFIER ||
+		    strcmp(expr_arg->v.identifier, var) != 0) {
+			return 0;
+		}
+	}
+	list_for_each(expr->v.application.expr_args,
+	              struct expr *,
+	              if (!passes_on(_value, fn, arity, i, var)) return 0;);
+	return 1;
+}
+
+static int is_static_param(struct list *def_values,
+                           char *fn,
+                           size_t arity,
+                           size_t i) {
+	list_for_each(def_values,
+	              struct def_value *,
+	              struct expr *pattern = list_get(_value->expr_params, i);
+	              if (!is_variable_pattern(pattern) ||
+	                  !passes_on(
+	                    _value->value, fn, arity, i, pattern_var(pattern)))
+		              return 0;);
+	return 1;
+}
+
+/* copies expr, replacing saturated calls of the specialised function with
+ * calls of the specialisation, which take only its other args */
+static struct expr *replace_static_calls(struct simplifier *s,
+                                         struct specialisation *sp,
+                                         struct expr *expr) {
+	struct list_iter expr_args_iter;
+	struct expr *copy;
+	size_t i = 0;
+
+	if (expr->expr_type != EXPR_APPLICATION) {
+		return expr;
+	}
+	if (strcmp(expr->v.application.fn, sp->fn) == 0 &&
+	    list_length(expr->v.application.expr_args) >= sp->arity) {
+		copy = new_application(s, sp->name, expr->type);
+	} else {
+		copy  = arena_push_struct_zero(s->arena, struct expr);
+		*copy = *expr;
+		copy->v.application.expr_args = list_new(s->arena);
+		i                             = sp->arity;
+	}
+
+	expr_args_iter = list_iterate(expr->v.application.expr_args);
+	while (!list_iter_at_end(&expr_args_iter)) {
+		struct expr *expr_arg = list_iter_next(&expr_args_iter);
+		if (i >= sp->arity || sp->args[i] == NULL) {
+			list_append(copy->v.application.expr_args,
+			            replace_static_calls(s, sp, expr_arg));
+		}
+		i++;
+	}
+	return copy;
+}
+
+/* the specialisation's clause for one of the function's clauses. NULL if a
+ * known function would be shadowed by one of its variables */
+static struct def_value *specialised_clause(struct simplifier *s,
+                                            struct specialisation *sp,
+                                            struct def_value *clause) {
+	struct def_value *def_value =
+		arena_push_struct_zero(s->arena, struct def_value);
+	struct list_iter params_iter = list_iterate(clause->expr_params);
+	struct map *bindings         = map_new();
+	struct set *vars             = set_new();
+	int is_shadowed              = 0;
+	size_t i                     = 0;
+
+	list_for_each(clause->expr_params,
+	              struct expr *,
+	              collect_pattern_vars(_value, vars));
+
+	def_value->name        = sp->name;
+	def_value->expr_params = list_new(s->arena);
+	while (!list_iter_at_end(&params_iter)) {
+		struct expr *pattern = list_iter_next(&params_iter);
+		if (sp->args[i] == NULL) {
+			list_append(def_value->expr_params, pattern);
+		} else {
+			if (pattern_var(pattern) != NULL) {
+				map_put_str(bindings, pattern_var(pattern), sp->args[i]);
+			}
+			is_shadowed |= set_has_str(vars, sp->args[i]->v.identifier);
+		}
+		i++;
+	}
+
+	if (!is_shadowed) {
+		def_value->value =
+			substitute(s, replace_static_calls(s, sp, clause->value), bindings);
+	}
+	map_free(bindings);
+	set_free(vars);
+	return def_value->value == NULL ? NULL : def_value;
+}
+
+/* the function's type without its specialised params */
+static struct type *specialised_type(struct simplifier *s,
+                                     struct specialisation *sp) {
+	struct type *fn_type = sp->dec_type->type;
+	struct type *type    = function_type_at(fn_type, sp->arity);
+	size_t i;
+	for (i = sp->arity; i > 0; i--) {
+		if (sp->args[i - 1] == NULL) {
+			type =
+				new_arrow(s, fn_type, function_param_type(fn_type, i - 1), type);
+		}
+	}
+	return type;
+}
+
+/* "fn arg..." with - for params which aren't specialised */
+static char *specialisation_key(struct simplifier *s,
+                                struct specialisation *sp) {
+	size_t key_len = strlen(sp->fn) + 1;
+	char *key;
+	size_t i;
+
+	for (i = 0; i < sp->arity; i++) {
+		key_len +=
+			(sp->args[i] == NULL ? 1 : strlen(sp->args[i]->v.identifier)) + 1;
+	}
+	key = arena_push_array_zero(s->arena, key_len, char);
+	strcpy(key, sp->fn);
+	for (i = 0; i < sp->arity; i++) {
+		strcat(key, " ");
+		strcat(key, sp->args[i] == NULL ? "-" : sp->args[i]->v.identifier);
+	}
+	return key;
+}
+
+/* the known functions joined with _, to name the specialisation after */
+static char *specialised_args_name(struct simplifier *s,
+                                   struct specialisation *sp) {
+	size_t name_len = 1;
+	char *name;
+	size_t i;
+
+	for (i = 0; i < sp->arity; i++) {
+		if (sp->args[i] != NULL) {
+			name_len += strlen(sp->args[i]->v.identifier) + 1;
+		}
+	}
+	name = arena_push_array_zero(s->arena, name_len, char);
+	for (i = 0; i < sp->arity; i++) {
+		if (sp->args[i] != NULL) {
+			if (name[0] != '\0') {
+				strcat(name, "_");
+			}
+			strcat(name, sp->args[i]->v.identifier);
+		}
+	}
+	return name;
+}
+
+/* defines the specialisation, returning its name, or NULL if the function
+ * can't be specialised or its copies would exceed the size budget */
+static char *specialise(struct simplifier *s,
+                        struct specialisation *sp,
+                        struct list *def_values) {
+	struct list *def_values_new = list_new(s->arena);
+	char *key                   = specialisation_key(s, sp);
+	struct dec_type *dec_type;
+	size_t count;
+	size_t size = 0;
+
+	sp->name = map_get_str(s->specialisations, key);
+	if (sp->name != NULL) {
+		return sp->name[0] == '\0' ? NULL : sp->name;
+	}
+
+	/* past the budget, calls keep using the shared function */
+	map_put_str(s->specialisations, key, "");
+	count = (size_t)map_get_str(s->specialised_counts, sp->fn);
+	list_for_each(def_values,
+	              struct def_value *,
+	              size += expr_size(_value->value));
+	if (count == SPECIALISATIONS_MAX ||
+	    s->specialised_size + size > SPECIALISE_SIZE_MAX) {
+		return NULL;
+	}
+
+	sp->name = joined_name(s, sp->fn, specialised_args_name(s, sp));
+	list_for_each(def_values,
+	              struct def_value *,
+	              struct def_value *def_value =
+	                specialised_clause(s, sp, _value);
+	              if (def_value == NULL) return NULL;
+	              list_append(def_values_new, def_value));
+
+	dec_type             = arena_push_struct_zero(s->arena, struct dec_type);
+	dec_type->name       = sp->name;
+	dec_type->type       = specialised_type(s, sp);
+	dec_type->region_var = sp->dec_type->region_var;
+	map_put_str(s->dec_types, sp->name, dec_type);
+	map_put_str(s->specialisations, key, sp->name);
+	map_put_str(s->specialised_counts, sp->fn, (void *)(count + 1));
+	s->specialised_size += size;
+
+	list_append(s->stmts_new, new_stmt(s, STMT_DEC_TYPE, dec_type));
+	list_for_each(def_values_new,
+	              struct def_value *,
+	              add_def_value(s, _value);
+	              list_append(s->stmts_new, new_stmt(s, STMT_DEF_VALUE, _value)));
+	return sp->name;
+}
+
+/* rewrites a call passing known functions into a call to a specialisation
+ * of its function. NULL if the call isn't one */
+static struct expr *
+specialise_call(struct simplifier *s, struct expr *call, struct set *locals) {
+	char *fn = call->v.application.fn;
+	struct list_iter expr_args_iter;
+	struct specialisation sp;
+	struct list *def_values;
+	struct expr *specialised;
+	size_t known = 0;
+	size_t i;
+
+	if (!s->specialise || set_has_str(locals, fn) || !is_plain_name(fn)) {
+		return NULL;
+	}
+	def_values  = map_get_str(s->def_values, fn);
+	sp.dec_type = map_get_str(s->dec_types, fn);
+	if (def_values == NULL || sp.dec_type == NULL) {
+		return NULL;
+	}
+	sp.fn = fn;
+	sp.arity =
+		list_length(((struct def_value *)list_head(def_values))->expr_params);
+	if (sp.arity == 0 ||
+	    list_length(call->v.application.expr_args) < sp.arity) {
+		return NULL;
+	}
+
+	sp.args        = arena_push_array_zero(s->arena, sp.arity, struct expr *);
+	expr_args_iter = list_iterate(call->v.application.expr_args);
+	for (i = 0; i < sp.arity; i++) {
+		struct expr *expr_arg = strip_groupings(list_iter_next(&expr_args_iter));
+		if (known_function(s, expr_arg, locals) != NULL &&
+		    is_static_param(def_values, fn, sp.arity, i)) {
+			sp.args[i] = expr_arg;
+			known++;
+		}
+	}
+	/* the specialisation must still take a param to stay a function */
+	if (known == 0 || known == sp.arity ||
+	    specialise(s, &sp, def_values) == NULL) {
+		return NULL;
+	}
+
+	specialised    = new_application(s, sp.name, call->type);
+	expr_args_iter = list_iterate(call->v.application.expr_args);
+	for (i = 0; !list_iter_at_end(&expr_args_iter); i++) {
+		struct expr *expr_arg = list_iter_next(&expr_args_iter);
+		if (i >= sp.arity || sp.args[i] == NULL) {
+			list_append(specialised->v.application.expr_args, expr_arg);
+		}
+	}
+	return specialised;
+}
+
+static struct expr *simplify_expr(struct simplifier *s,
+                                  struct expr *expr,
+                                  struct set *locals,
+                                  size_t depth) {
+	switch (expr->expr_type) {
+	case EXPR_GROUPING:
+		return simplify_expr(s, expr->v.grouping, locals, depth);
+	case EXPR_APPLICATION: {
+		struct list *expr_args_new = list_new(s->arena);
+		struct expr *inlined;
+		list_map(expr_args_new,
+		         expr->v.application.expr_args,
+		         struct expr *,
+		         simplify_expr(s, _value, locals, depth));
+		expr->v.application.expr_args = expr_args_new;
+
+		if (depth < s->inline_depth_max) {
+			inlined = inline_call(s, expr, locals);
+			if (inlined == NULL) {
+				inlined = fuse_call(s, expr, locals);
+			}
+			if (inlined == NULL) {
+				inlined = specialise_call(s, expr, locals);
+			}
+			if (inlined != NULL) {
+				return simplify_expr(s, inlined, locals, depth + 1);
+			}
+		}
+		return expr;
+	}
+	default: return expr;
+	}
+}
+
+static void simplify_def_value(struct simplifier *s,
+                               struct def_value *def_value) {
+	struct set *locals = set_new();
+	list_for_each(def_value->expr_params,
+	              struct expr *,
+	              collect_pattern_vars(_value, locals));
+	def_value->value = simplify_expr(s, def_value->value, locals, 0);
+	set_free(locals);
+}
+
+static void add_dec_data(struct simplifier *s, struct dec_data *dec_data) {
+	list_for_each(
+		dec_data->dec_constructors,
+		struct dec_constructor *,
+		map_put_str(s->constructor_arities,
+	              _value->name,
+	              (void *)(_value->type_params == NULL
+	                         ? 0
+	                         : list_length(_value->type_params))));
+}
+
+void simplify(struct prog *prog, struct arena *arena, enum opt_level level) {
+	struct simplifier *s;
+	struct list *stmts;
+	size_t new_simplified = 0;
+
+	if (level == OPT_NONE) {
+		return;
+	}
+
+	s                      = arena_push_struct_zero(arena, struct simplifier);
+	s->arena               = arena;
+	s->def_values          = map_new();
+	s->constructor_arities = map_new();
+	s->dec_types           = map_new();
+	s->no_bindings         = map_new();
+	s->fusions             = map_new();
+	s->specialisations     = map_new();
+	s->specialised_counts  = map_new();
+	s->names               = set_new();
+	s->stmts_new           = list_new(arena);
+	s->specialise          = level == OPT_FULL;
+	s->inline_size_max  = level == OPT_FULL ? INLINE_SIZE_FULL : INLINE_SIZE_SIMPLE;
+	s->inline_depth_max =
+		level == OPT_FULL ? INLINE_DEPTH_FULL : INLINE_DEPTH_SIMPLE;
+
+	map_put_str(s->constructor_arities, ":", (void *)2);
+
+	collect_names(s, prog->stmts);
+	stmts = list_new(arena);
+	list_for_each(
+		prog->stmts, struct stmt *, float_stmt(s, _value, stmts, NULL));
+	prog->stmts = stmts;
+
+	list_for_each(
+		prog->stmts, struct stmt *, switch (_value->type) {
+			case STMT_DEF_VALUE: add_def_value(s, _value->v.def_value); break;
+			case STMT_DEC_DATA: add_dec_data(s, _value->v.dec_data); break;
+			case STMT_DEC_TYPE:
+				map_put_str(s->dec_types, _value->v.dec_type->name, _value->v.dec_type);
+				break;
+			default: break;
+		});
+
+	list_for_each(prog->stmts,
+	              struct stmt *,
+	              if (_value->type == STMT_DEF_VALUE)
+		              simplify_def_value(s, _value->v.def_value));
+
+	/* new functions can fuse and specialise further, defining more of them */
+	while (new_simplified < list_length(s->stmts_new)) {
+		struct stmt *stmt = list_get(s->stmts_new, new_simplified++);
+		if (stmt->type == STMT_DEF_VALUE) {
+			simplify_def_value(s, stmt->v.def_value);
+		}
+	}
+	list_for_each(
+		s->stmts_new, struct stmt *, list_append(prog->stmts, _value));
+
+	map_free(s->def_values);
+	map_free(s->dec_types);
+	map_free(s->fusions);
+	map_free(s->specialisations);
+	map_free(s->specialised_counts);
+	map_free(s->constructor_arities);
+	map_free(s->no_bindings);
+	set_free(s->names);
+}
@@ -0,0 +1,17 @@
+#ifndef RACC_SIMPLIFY_H
+#define RACC_SIMPLIFY_H
+
+#include "ast.h"
+#include <arena.h>
+
+/* optimisation level, as given by -O0/-O1/-O2 */
+enum opt_level { OPT_NONE, OPT_SIMPLE, OPT_FULL };
+
+/* rewrites a type checked program before code generation: floats let..in
+ * definitions to the top level and inlines small functions at known calls,
+ * selecting clauses statically where the arguments are known constructors.
+ * at OPT_FULL, calls passing known functions get copies of their function
+ * with those functions substituted in, within a size budget */
+void simplify(struct prog *prog, struct arena *arena, enum opt_level level);
+
+#endif
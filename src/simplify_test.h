@@ -0,0 +1,256 @@
+#include "arena.h"
+#include "ast.h"
+#include "lexer.h"
+#include "list.h"
+#include "parser.h"
+#include "simplify.h"
+#include "type_check.h"
+#include <ctest.h>
+#include <string.h>
+
+static struct expr *find_def_value(struct prog *prog, char *name) {
+	struct list_iter stmts_iter = list_iterate(prog->stmts);
+	while (!list_iter_at_end(&stmts_iter)) {
+		struct stmt *stmt = list_iter_next(&stmts_iter);
+		if (stmt->type == STMT_DEF_VALUE &&
+		    strcmp(stmt->v.def_value->name, name) == 0) {
+			return stmt->v.def_value->value;
+		}
+	}
+	return NULL;
+}
+
+/* simplifies the source, then checks condition against the value of main */
+#define SIMPLIFY_TEST(name, _source, _level, _condition)                       \
+	test name(void) {                                                            \
+		struct arena *arena = arena_alloc();                                       \
+		char *source        = _source;                                             \
+		struct error_log *log;                                                     \
+		struct token **tokens;                                                     \
+		struct prog *prog;                                                         \
+		struct expr *expr;                                                         \
+		log         = arena_push_struct_zero(arena, struct error_log);             \
+		log->source = source;                                                      \
+		tokens      = scan_tokens(source, arena, log);                             \
+		assert(log->had_error == 0);                                               \
+		prog = parse(tokens, arena, log);                                          \
+		assert(log->had_error == 0);                                               \
+		type_check(prog, arena, log);                                              \
+		assert(log->had_error == 0);                                               \
+		simplify(prog, arena, _level);                                             \
+		expr = find_def_value(prog, "main");                                       \
+		EXPECT(expr != NULL);                                                      \
+		EXPECT(_condition);                                                        \
+		arena_free(arena);                                                         \
+		PASS();                                                                    \
+	}
+
+static size_t count_def_values(struct prog *prog, char *name) {
+	size_t def_values_len = 0;
+	list_for_each(prog->stmts,
+	              struct stmt *,
+	              if (_value->type == STMT_DEF_VALUE &&
+	                  strcmp(_value->v.def_value->name, name) == 0)
+		              def_values_len++);
+	return def_values_len;
+}
+
+#define IS_APPLICATION_OF(expr, name)                                          \
+	((expr)->expr_type == EXPR_APPLICATION &&                                    \
+	 strcmp((expr)->v.application.fn, name) == 0)
+
+SIMPLIFY_TEST(simplify_inlines_small_functions,
+              "inc :: Int -> Int 'r;\n"
+              "inc x = x + 1;\n"
+              "main :: Int 'r;\n"
+              "main = inc 2;\n",
+              OPT_SIMPLE,
+              IS_APPLICATION_OF(expr, "+"))
+
+SIMPLIFY_TEST(simplify_does_nothing_without_optimisations,
+              "inc :: Int -> Int 'r;\n"
+              "inc x = x + 1;\n"
+              "main :: Int 'r;\n"
+              "main = inc 2;\n",
+              OPT_NONE,
+              IS_APPLICATION_OF(expr, "inc"))
+
+SIMPLIFY_TEST(simplify_selects_clauses_of_known_constructors,
+              "data Maybe a { Nothing | Just a }\n"
+              "fromJust :: Maybe Int -> Int 'r;\n"
+              "fromJust Nothing = 0;\n"
+              "fromJust (Just x) = x;\n"
+              "main :: Int 'r;\n"
+              "main = fromJust (Just 4);\n",
+              OPT_SIMPLE,
+              expr->expr_type == EXPR_LIT_INT && expr->v.lit_int == 4)
+
+SIMPLIFY_TEST(simplify_keeps_clauses_of_unknown_values,
+              "data Maybe a { Nothing | Just a }\n"
+              "fromJust :: Maybe Int -> Int 'r;\n"
+              "fromJust Nothing = 0;\n"
+              "fromJust (Just x) = x;\n"
+              "maybeInt :: Maybe Int 'r;\n"
+              "maybeInt = Just 4;\n"
+              "main :: Int 'r;\n"
+              "main = fromJust maybeInt;\n",
+              OPT_FULL,
+              IS_APPLICATION_OF(expr, "fromJust"))
+
+SIMPLIFY_TEST(simplify_beta_reduces_function_arguments,
+              "inc :: Int -> Int 'r;\n"
+              "inc x = x + 1;\n"
+              "apply :: (Int -> Int) -> Int -> Int 'r;\n"
+              "apply f x = f x;\n"
+              "main :: Int 'r;\n"
+              "main = apply inc 2;\n",
+              OPT_SIMPLE,
+              IS_APPLICATION_OF(expr, "+"))
+
+SIMPLIFY_TEST(simplify_does_not_duplicate_work,
+              "inc :: Int -> Int 'r;\n"
+              "inc x = x + 1;\n"
+              "dup :: Int -> Int 'r;\n"
+              "dup x = x + x;\n"
+              "main :: Int 'r;\n"
+              "main = dup (inc 2);\n",
+              OPT_FULL,
+              IS_APPLICATION_OF(expr, "dup"))
+
+SIMPLIFY_TEST(simplify_does_not_unroll_recursion_on_unknown_values,
+              "len :: [Int] -> Int 'r;\n"
+              "len [] = 0;\n"
+              "len (_ : xs) = 1 + len xs;\n"
+              "nums :: [Int] 'r;\n"
+              "nums = 1 : nums;\n"
+              "main :: Int 'r;\n"
+              "main = len nums;\n",
+              OPT_FULL,
+              IS_APPLICATION_OF(expr, "len"))
+
+SIMPLIFY_TEST(simplify_floats_let_in_expressions,
+              "main :: Int 'r;\n"
+              "main = let y :: Int 'r;\n"
+              "           y = 4;\n"
+              "        in y;\n",
+              OPT_SIMPLE,
+              expr->expr_type == EXPR_IDENTIFIER &&
+                find_def_value(prog, "y_1") != NULL)
+
+SIMPLIFY_TEST(simplify_renames_lets_binding_the_same_name,
+              "a :: Int 'r;\n"
+              "a = let y :: Int 'r;\n"
+              "        y = 5;\n"
+              "     in y + 1;\n"
+              "b :: Int 'r;\n"
+              "b = let y :: Int 'r;\n"
+              "        y = 100;\n"
+              "     in y + 2;\n"
+              "main :: Int 'r;\n"
+              "main = a + b;\n",
+              OPT_SIMPLE,
+              count_def_values(prog, "y") == 0 &&
+                count_def_values(prog, "y_1") == 1 &&
+                count_def_values(prog, "y_2") == 1)
+
+SIMPLIFY_TEST(simplify_renames_lets_shadowing_top_level_names,
+              "y :: Int 'r;\n"
+              "y = 100;\n"
+              "main :: Int 'r;\n"
+              "main = let y :: Int 'r;\n"
+              "           y = 5;\n"
+              "        in y + 1;\n",
+              OPT_SIMPLE,
+              count_def_values(prog, "y") == 1 &&
+                find_def_value(prog, "y")->v.lit_int == 100 &&
+                count_def_values(prog, "y_1") == 1 &&
+                find_def_value(prog, "y_1")->v.lit_int == 5)
+
+#define LIST_FUNCTIONS                                                         \
+	"map :: (Int -> Int) -> [Int] -> [Int] 'r;\n"                                \
+	"map _ [] = [];\n"                                                           \
+	"map f (x:xs) = f x : map f xs;\n"                                           \
+	"take :: Int -> [Int] -> [Int] 'r;\n"                                        \
+	"take 0 _ = [];\n"                                                           \
+	"take n (x:xs) = x : take (n - 1) xs;\n"                                     \
+	"sum :: [Int] -> Int 'r;\n"                                                  \
+	"sum [] = 0;\n"                                                              \
+	"sum (x:xs) = x + sum xs;\n"                                                 \
+	"inc :: Int -> Int 'r;\n"                                                    \
+	"inc x = x + 1;\n"                                                           \
+	"nums :: [Int] 'r;\n"                                                        \
+	"nums = 1 : nums;\n"
+
+SIMPLIFY_TEST(simplify_fuses_consumers_of_producers,
+              LIST_FUNCTIONS "main :: Int 'r;\n"
+                             "main = sum (take 10 nums);\n",
+              OPT_SIMPLE,
+              IS_APPLICATION_OF(expr, "sum_take") &&
+                find_def_value(prog, "sum_take") != NULL)
+
+SIMPLIFY_TEST(simplify_fuses_pipelines,
+              LIST_FUNCTIONS "main :: Int 'r;\n"
+                             "main = sum (map inc (map inc nums));\n",
+              OPT_SIMPLE,
+              IS_APPLICATION_OF(expr, "sum_map_map"))
+
+SIMPLIFY_TEST(simplify_does_not_fuse_unknown_lists,
+              LIST_FUNCTIONS "main :: Int 'r;\n"
+                             "main = sum nums;\n",
+              OPT_SIMPLE,
+              IS_APPLICATION_OF(expr, "sum"))
+
+#define ITERATE                                                                \
+	"iter :: (Int -> Int) -> Int -> Int -> Int 'r;\n"                            \
+	"iter _ 0 x = x;\n"                                                          \
+	"iter f n x = iter f (n - 1) (f x);\n"                                       \
+	"inc :: Int -> Int 'r;\n"                                                    \
+	"inc x = x + 1;\n"                                                           \
+	"n :: Int 'r;\n"                                                             \
+	"n = 10;\n"
+
+SIMPLIFY_TEST(simplify_specialises_known_function_args,
+              ITERATE "main :: Int 'r;\n"
+                      "main = iter inc n 0;\n",
+              OPT_FULL,
+              IS_APPLICATION_OF(expr, "iter_inc") &&
+                list_length(expr->v.application.expr_args) == 2 &&
+                find_def_value(prog, "iter_inc") != NULL)
+
+SIMPLIFY_TEST(simplify_specialises_only_at_full_optimisation,
+              ITERATE "main :: Int 'r;\n"
+                      "main = iter inc n 0;\n",
+              OPT_SIMPLE,
+              IS_APPLICATION_OF(expr, "iter"))
+
+SIMPLIFY_TEST(simplify_does_not_specialise_changing_args,
+              "twist :: (Int -> Int) -> (Int -> Int) -> Int -> Int 'r;\n"
+              "twist _ _ 0 = 0;\n"
+              "twist f g x = f (twist g f (x - 1));\n"
+              "inc :: Int -> Int 'r;\n"
+              "inc x = x + 1;\n"
+              "n :: Int 'r;\n"
+              "n = 10;\n"
+              "main :: Int 'r;\n"
+              "main = twist inc inc n;\n",
+              OPT_FULL,
+              IS_APPLICATION_OF(expr, "twist"))
+
+void test_simplify_h(void) {
+	TEST(simplify_inlines_small_functions);
+	TEST(simplify_does_nothing_without_optimisations);
+	TEST(simplify_selects_clauses_of_known_constructors);
+	TEST(simplify_keeps_clauses_of_unknown_values);
+	TEST(simplify_beta_reduces_function_arguments);
+	TEST(simplify_does_not_duplicate_work);
+	TEST(simplify_does_not_unroll_recursion_on_unknown_values);
+	TEST(simplify_floats_let_in_expressions);
+	TEST(simplify_renames_lets_binding_the_same_name);
+	TEST(simplify_renames_lets_shadowing_top_level_names);
+	TEST(simplify_fuses_consumers_of_producers);
+	TEST(simplify_fuses_pipelines);
+	TEST(simplify_does_not_fuse_unknown_lists);
+	TEST(simplify_specialises_known_function_args);
+	TEST(simplify_specialises_only_at_full_optimisation);
+	TEST(simplify_does_not_specialise_changing_args);
+}
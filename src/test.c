@@ -1,10 +1,16 @@
 #include "lexer_test.h"
 #include "parser_test.h"
+#include "partial_eval_test.h"
+#include "region_test.h"
+#include "simplify_test.h"
 #include "type_check_test.h"
 
 int main(void) {
 	TESTS(test_lexer_h);
 	TESTS(test_parser_h);
 	TESTS(test_type_check_h);
+	TESTS(test_simplify_h);
+	TESTS(test_partial_eval_h);
+	TESTS(test_region_h);
 	return tests_summarize();
 }
@@ -47,7 +47,8 @@ enum token_type {
 	TOK_SQUARE_R,
 	TOK_COMMA,
 	TOK_AT,
-	TOK_TICK
+	TOK_TICK,
+	TOK_BANG
 };
 
 struct token {
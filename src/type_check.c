@@ -96,6 +96,7 @@ struct type type_bool = {
 	APPLY_A_ARROW_B(A, APPLY_A_ARROW_B(B, C))
 
 #define TYPE_EQ APPLY_A_ARROW_B_ARROW_C(TYPE_VAR_A, TYPE_VAR_A, &type_bool)
+#define TYPE_PAR APPLY_A_ARROW_B_ARROW_C(TYPE_VAR_A, TYPE_VAR_B, TYPE_VAR_B)
 
 #define TYPE_CONSTRUCTOR_CONS                                                  \
 	APPLY_A_ARROW_B_ARROW_C(TYPE_VAR_A, TYPE_LIST_A, TYPE_LIST_A)
@@ -874,6 +875,8 @@ void type_check(struct prog *prog, struct arena *arena, struct error_log *log) {
 		tc, "+", APPLY_A_ARROW_B_ARROW_C(&type_int, &type_int, &type_int));
 	set_value_type(
 		tc, "-", APPLY_A_ARROW_B_ARROW_C(&type_int, &type_int, &type_int));
+	set_value_type(tc, "par", TYPE_PAR);
+	set_value_type(tc, "seq", TYPE_PAR);
 
 	type_check_prog(tc, prog);
 
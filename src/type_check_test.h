@@ -151,6 +151,14 @@ TYPE_CHECK_TEST_REJECT(type_check_rejects_invalid_nested_generic_uses_of_equal,
                        "myFunc :: Int -> Int -> Bool 'r;\n"
                        "myFunc x y = (x == y) == 3;")
 
+TYPE_CHECK_TEST_ACCEPT(type_check_accepts_valid_uses_of_par_and_seq,
+                       "myFunc :: Int -> Char -> Int 'r;\n"
+                       "myFunc x y = par y (seq x (x + 1));")
+
+TYPE_CHECK_TEST_REJECT(type_check_rejects_invalid_uses_of_par_and_seq,
+                       "myFunc :: Int -> Char -> Int 'r;\n"
+                       "myFunc x y = par x y;")
+
 TYPE_CHECK_TEST_ACCEPT(type_check_accepts_valid_basic_data_types,
                        "data YesNo { Yes | No }\n"
                        "yes :: YesNo 'r;\n"
@@ -247,6 +255,8 @@ void test_type_check_h(void) {
 	TEST(type_check_rejects_invalid_use_of_literal_strings);
 	TEST(type_check_accepts_valid_nested_generic_uses_of_equal);
 	TEST(type_check_rejects_invalid_nested_generic_uses_of_equal);
+	TEST(type_check_accepts_valid_uses_of_par_and_seq);
+	TEST(type_check_rejects_invalid_uses_of_par_and_seq);
 	TEST(type_check_accepts_valid_basic_data_types);
 	TEST(type_check_accepts_valid_basic_data_types_with_concrete_args);
 	TEST(type_check_rejects_invalid_basic_data_types_with_unknown_args);